@@ -0,0 +1,489 @@
+#ifndef CARESCRIPT_AOT_HPP
+#define CARESCRIPT_AOT_HPP
+
+#include "carescript-parsing.hpp"
+
+#include <sstream>
+
+namespace carescript {
+
+// Ahead of time compilation of pre processed labels into the C++ source of an
+// extension. Baking the compiled extension makes the interpreter run those labels
+// natively: every statement calls its builtin directly, with the argument list
+// already split. Arguments are compiled too, each operator of an expression is
+// resolved to its overloads when the extension is baked and applied through
+// `expression_apply`, so an operator with one overload for the parsed type calls
+// its `run` right away and the others pick theirs through a site of their own.
+// Literals are converted once at bake time. Expressions calling builtins, with
+// literals of extension types or operators whose overloads parse differently go
+// through `evaluate_expression`, like expressions whose operators changed before baking.
+// Results, errors and budget steps are the same as interpreted.
+// A label only runs natively while its pre processed code is unchanged, otherwise
+// the interpreter falls back to running it itself.
+//
+// Builtins and operators are looked up when the extension gets baked, so bake it after
+// every other extension. Macros in argument lists are the ones of the transpiling interpreter.
+
+struct ScriptAotOptions {
+    // id() of the generated extension
+    std::string id = "aot";
+    // how the generated source includes the api
+    std::string include = "carescript-api.hpp";
+};
+
+// quotes `str` as a C++ string literal
+inline static std::string aot_quote(const std::string& str) noexcept {
+    static const char* digits = "01234567";
+    std::string ret = "\"";
+    for(unsigned char c : str) {
+        switch(c) {
+            case '\\': ret += "\\\\"; break;
+            case '"': ret += "\\\""; break;
+            case '\n': ret += "\\n"; break;
+            case '\t': ret += "\\t"; break;
+            case '\r': ret += "\\r"; break;
+            case '?': ret += "\\?"; break;
+            default:
+                if(c < 32 || c >= 127) {
+                    ret += '\\';
+                    ret += digits[(c >> 6) & 7];
+                    ret += digits[(c >> 3) & 7];
+                    ret += digits[c & 7];
+                }
+                else ret += c;
+        }
+    }
+    return ret + "\"";
+}
+
+// splits an argument list the same way `parse_argumentlist` does
+inline static std::vector<std::string> aot_split_arguments(std::string source, ScriptSettings& settings) noexcept {
+    source.erase(source.begin());
+    source.pop_back();
+
+    auto lexed = settings.interpreter.lexer.p_argumentlist(source);
+    if(lexed.empty()) return {};
+    std::vector<std::string> args(1);
+    for(auto i : lexed) {
+        if(!i.str && i.src == ",") {
+            args.push_back({});
+        }
+        else {
+            if(i.str) i.src = "\"" + i.src + "\"";
+            else if(settings.interpreter.script_macros.count(i.src) != 0) i.src = settings.interpreter.script_macros.at(i.src);
+
+            args.back() += " " + i.src;
+        }
+    }
+    return args;
+}
+
+// applies an operator of a compiled expression like `expression_apply`. Its
+// site isn't touched while labels run in parallel, like those of `operator_cache`
+inline static ScriptVariable aot_apply(const _expressionToken& token, const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings, _expressionErrors& errors) noexcept {
+    if(token.site != nullptr && settings.interpreter.operator_cache.shared.load(std::memory_order_relaxed) != 0) {
+        _expressionToken unshared = token;
+        unshared.site = nullptr;
+        return expression_apply(unshared,left,right,settings,errors);
+    }
+    return expression_apply(token,left,right,settings,errors);
+}
+
+// the value of a compiled parenthesized part, like `_operatorToken::get_val` gives it
+inline static ScriptVariable aot_capsule(ScriptVariable value, const char* capsule, ScriptSettings& settings, _expressionErrors& errors) noexcept {
+    if(settings.error_msg != "") {
+        errors.push("Error while parsing " + std::string(capsule) + ": " + settings.error_msg);
+        settings.error_msg = "";
+        return script_null;
+    }
+    return value;
+}
+
+// the result of a compiled expression, like `evaluate_expression` gives it
+inline static ScriptVariable aot_result(ScriptVariable result, const _expressionErrors& errors, const char* source, ScriptSettings& settings) noexcept {
+    if(settings.await) return script_null;
+    if(errors.changed() || is_null(result)) {
+        settings.error_msg = "\nError in expression: " + std::string(source) + "\n";
+        for(auto& i : errors.messages) settings.error_msg += i + "\n";
+        if(!errors.messages.empty()) settings.error_msg.pop_back();
+        return script_null;
+    }
+    return result;
+}
+
+// literals that convert to the same value every time
+inline static bool aot_foldable(const ScriptVariable& value) noexcept {
+    return !is_null(value) && (is_typeof<ScriptNumberValue>(value) || is_typeof<ScriptStringValue>(value) || is_typeof<ScriptNameValue>(value));
+}
+
+// turns expressions into C++ functions that do what `evaluate_expression` does for them
+struct _aotExpressions {
+    struct _internalToken {
+        enum { OP, VAL, CAPSULE } kind = VAL;
+        KittenToken token;
+        int type = ScriptOperator::UNKNOWN;
+        int priority = 0;
+        // the operator, literal or expression of the capsule
+        size_t index = 0;
+    };
+    struct _internalOperator {
+        std::string name;
+        int type = ScriptOperator::UNKNOWN;
+        int priority = 0;
+    };
+    struct _internalExpression {
+        // literals and operators used, including those of its capsules
+        std::vector<size_t> literals;
+        std::vector<size_t> operators;
+    };
+    static constexpr size_t failed = (size_t)-1;
+    static constexpr int max_prec = 999999999;
+
+    ScriptSettings& settings;
+    std::vector<KittenToken> literals;
+    std::vector<_internalOperator> operators;
+    std::vector<_internalExpression> expressions;
+    std::unordered_map<std::string,size_t> compiled;
+    std::stringstream functions;
+
+    _aotExpressions(ScriptSettings& s): settings(s) {}
+
+    inline size_t literal_of(const KittenToken& token) noexcept {
+        for(size_t i = 0; i < literals.size(); ++i) {
+            if(literals[i].src == token.src && literals[i].str == token.str) return i;
+        }
+        literals.push_back({token.src,token.str});
+        return literals.size() - 1;
+    }
+    inline size_t operator_of(const std::string& name, int type, int priority) noexcept {
+        for(size_t i = 0; i < operators.size(); ++i) {
+            if(operators[i].name == name && operators[i].type == type && operators[i].priority == priority) return i;
+        }
+        operators.push_back({name,type,priority});
+        return operators.size() - 1;
+    }
+
+    inline std::string value_of(const _internalToken& token) const noexcept {
+        if(token.kind == token.CAPSULE) {
+            return "aot_capsule(expression_" + std::to_string(token.index) + "(ext,settings)," + aot_quote(token.token.src) + ",settings,errors)";
+        }
+        return "ext.literals[" + std::to_string(token.index) + "]";
+    }
+
+    // the code of `expression_check_prec`, its result goes into `target`
+    inline bool emit(const std::vector<_internalToken>& tokens, size_t& state, int maxprec, const std::string& target, const std::string& indent, std::string& out, size_t& temps) const noexcept {
+        if(state >= tokens.size()) return false;
+        const std::string in = indent + "    ";
+        auto temp = [&]() { return "v" + std::to_string(temps++); };
+        out += indent + "do {\n";
+        out += in + "if(errors.changed()) break;\n";
+        out += in + "if(!settings.await && !script_tick(settings)) { errors.push(script_budget_exhausted); break; }\n";
+        const _internalToken& lhs = tokens[state++];
+        std::string value;
+        bool capsule = false;
+        if(lhs.kind == lhs.OP) {
+            const std::string operand = temp();
+            out += in + "ScriptVariable " + operand + " = script_null;\n";
+            if(!emit(tokens,state,lhs.priority,operand,in,out,temps)) return false;
+            value = temp();
+            out += in + "ScriptVariable " + value + " = aot_apply(ext.operators[" + std::to_string(lhs.index) + "]," + operand + ",script_null,settings,errors);\n";
+            out += in + "if(errors.changed()) break;\n";
+        }
+        else {
+            value = value_of(lhs);
+            capsule = lhs.kind == lhs.CAPSULE;
+        }
+
+        while(state < tokens.size()) {
+            const _internalToken& op = tokens[state];
+            if(op.kind != op.OP || op.type != ScriptOperator::BINARY) return false;
+            if(op.priority >= maxprec) break;
+            ++state;
+            const std::string rhs = temp();
+            out += in + "ScriptVariable " + rhs + " = script_null;\n";
+            if(!emit(tokens,state,op.priority,rhs,in,out,temps)) return false;
+            out += in + "if(errors.changed()) break;\n";
+            // a capsule on the left runs after the right operand
+            if(capsule) {
+                const std::string left = temp();
+                out += in + "ScriptVariable " + left + " = " + value + ";\n";
+                out += in + "if(errors.changed()) break;\n";
+                value = left;
+                capsule = false;
+            }
+            const std::string result = temp();
+            out += in + "ScriptVariable " + result + " = aot_apply(ext.operators[" + std::to_string(op.index) + "]," + value + "," + rhs + ",settings,errors);\n";
+            out += in + "if(errors.changed()) break;\n";
+            value = result;
+        }
+        out += in + target + " = " + value + ";\n";
+        out += indent + "} while(0);\n";
+        return true;
+    }
+
+    // the index of the function for `source`, `failed` if it can't be compiled
+    inline size_t compile(const std::string& source) noexcept {
+        auto found = compiled.find(source);
+        if(found != compiled.end()) return found->second;
+        compiled[source] = failed;
+
+        _internalExpression expression;
+        std::vector<_internalToken> tokens;
+        for(auto& i : settings.interpreter.lexer.p_expression(source)) {
+            _internalToken token;
+            token.token = i;
+            if(!i.str && is_operator(i.src,settings)) {
+                token.kind = token.OP;
+            }
+            else if(!i.str && i.src[0] == '(') {
+                token.kind = token.CAPSULE;
+                token.index = compile(i.src.substr(1,i.src.size() - 2));
+                if(token.index == failed) return failed;
+                const _internalExpression& inner = expressions[token.index];
+                expression.literals.insert(expression.literals.end(),inner.literals.begin(),inner.literals.end());
+                expression.operators.insert(expression.operators.end(),inner.operators.begin(),inner.operators.end());
+            }
+            else if(!i.str && (settings.interpreter.has_builtin(i.src) || settings.interpreter.has_rawbuiltin(i.src))) {
+                return failed;
+            }
+            else {
+                if(!aot_foldable(to_var(i,settings))) return failed;
+                token.index = literal_of(i);
+                expression.literals.push_back(token.index);
+            }
+            tokens.push_back(std::move(token));
+        }
+        if(tokens.empty()) return failed;
+
+        // the operator types follow from their positions, like in `expression_force_parse`
+        for(size_t i = 0; i < tokens.size() && tokens.size() != 1; ++i) {
+            if(tokens[i].kind != _internalToken::OP) {
+                if(++i >= tokens.size()) break;
+                if(tokens[i].kind != _internalToken::OP) return failed;
+                tokens[i].type = ScriptOperator::BINARY;
+            }
+            else {
+                tokens[i].type = ScriptOperator::UNARY;
+            }
+            const ScriptOperator* first = nullptr;
+            for(auto& o : settings.interpreter.script_operators.at(tokens[i].token.src)) {
+                if(o.type != tokens[i].type) continue;
+                if(first == nullptr) first = &o;
+                // more than one way to parse it
+                else if(o.priority != first->priority) return failed;
+            }
+            if(first == nullptr) return failed;
+            tokens[i].priority = first->priority;
+            tokens[i].index = operator_of(tokens[i].token.src,tokens[i].type,first->priority);
+            expression.operators.push_back(tokens[i].index);
+        }
+
+        std::string body;
+        if(tokens.size() == 1) {
+            if(tokens[0].kind == _internalToken::OP) return failed;
+            body = "    result = " + value_of(tokens[0]) + ";\n";
+        }
+        else {
+            size_t state = 0;
+            size_t temps = 0;
+            if(!emit(tokens,state,max_prec,"result","    ",body,temps) || state != tokens.size()) return failed;
+        }
+
+        const size_t index = expressions.size();
+        expressions.push_back(std::move(expression));
+        functions << "ScriptVariable expression_" << index << "(CompiledExtension& ext, ScriptSettings& settings) {\n";
+        functions << "    _expressionErrors errors;\n";
+        functions << "    ScriptVariable result = script_null;\n";
+        functions << body;
+        functions << "    return aot_result(std::move(result),errors," << aot_quote(source) << ",settings);\n";
+        functions << "}\n\n";
+        compiled[source] = index;
+        return index;
+    }
+};
+
+// the extension source for all labels in `settings.labels`
+inline static std::string transpile(ScriptSettings& settings, const ScriptAotOptions& options = {}) noexcept {
+    std::vector<std::string> builtins;
+    std::vector<std::string> rawbuiltins;
+    _aotExpressions expressions(settings);
+    auto index_of = [](std::vector<std::string>& list, const std::string& name) {
+        for(size_t i = 0; i < list.size(); ++i) {
+            if(list[i] == name) return i;
+        }
+        list.push_back(name);
+        return list.size() - 1;
+    };
+
+    std::stringstream steps;
+    std::stringstream natives;
+    size_t label_index = 0;
+    for(auto& [name,label] : settings.labels) {
+        std::vector<lexed_kittens> lines;
+        long long line = -1;
+        for(auto& i : label.lines) {
+            if((long long)i.line != line) {
+                line = i.line;
+                lines.push_back({});
+            }
+            lines.back().push_back(i);
+        }
+        bool valid = true;
+        for(auto& i : lines) {
+            if(i.size() != 2 || i[0].str || i[1].str || i[1].src.front() != '(') valid = false;
+        }
+        // the interpreter reports the error
+        if(!valid) continue;
+
+        const std::string fun = "step_" + std::to_string(label_index++);
+        steps << "// @" << name << "\n";
+        steps << "_statementResult " << fun << "(_labelFrame& frame, ScriptSettings& settings, std::string& error) {\n";
+        steps << "    auto& ext = *(CompiledExtension*)frame.native.data;\n";
+        steps << "    switch(settings.line) {\n";
+        for(size_t i = 0; i < lines.size(); ++i) {
+            const std::string& statement = lines[i][0].src;
+            std::string arguments = lines[i][1].src;
+            steps << "        case " << i + 1 << ": {\n";
+            if(settings.interpreter.has_rawbuiltin(statement)) {
+                arguments.erase(arguments.begin());
+                arguments.pop_back();
+                const size_t raw = index_of(rawbuiltins,statement);
+                steps << "            if(!ext.rawbuiltins[" << raw << "]) return run_label_call(frame,settings,error,nullptr," << aot_quote(statement) << ",{},frame.lines[" << i << "][0].line);\n";
+                steps << "            return run_label_rawcall(frame,settings,error,ext.rawbuiltins[" << raw << "]," << aot_quote(arguments) << ");\n";
+                steps << "        }\n";
+                continue;
+            }
+            auto args = aot_split_arguments(arguments,settings);
+            steps << "            ScriptArglist args;\n";
+            if(!args.empty()) {
+                steps << "            args.reserve(" << args.size() << ");\n";
+                steps << "            do {\n";
+                for(auto& arg : args) {
+                    const size_t expression = expressions.compile(arg);
+                    if(expression != expressions.failed) {
+                        steps << "                args.push_back(ext.compiled[" << expression << "] ? expression_" << expression << "(ext,settings) : evaluate_expression(" << aot_quote(arg) << ",settings));\n";
+                    }
+                    else {
+                        steps << "                args.push_back(evaluate_expression(" << aot_quote(arg) << ",settings));\n";
+                    }
+                    steps << "                if(settings.error_msg != \"\") { args.clear(); break; }\n";
+                }
+                steps << "            } while(0);\n";
+            }
+            steps << "            return run_label_call(frame,settings,error,ext.builtin(" << index_of(builtins,statement) << ")," << aot_quote(statement) << ",args,frame.lines[" << i << "][0].line);\n";
+            steps << "        }\n";
+        }
+        steps << "    }\n";
+        steps << "    return _statementResult::DONE;\n";
+        steps << "}\n\n";
+
+        natives << "            {" << aot_quote(name) << ",{" << script_label_hash(label) << "ull," << fun << ",this}},\n";
+    }
+
+    auto list = [](const std::vector<std::string>& names) {
+        std::string ret;
+        for(auto& i : names) ret += "\n            " + aot_quote(i) + ",";
+        return ret;
+    };
+
+    auto indices = [](const std::vector<size_t>& list) {
+        std::string ret;
+        for(auto& i : list) ret += std::to_string(i) + ",";
+        return ret;
+    };
+    std::string literal_tokens;
+    for(auto& i : expressions.literals) literal_tokens += "\n            {" + aot_quote(i.src) + "," + (i.str ? "true" : "false") + "},";
+    std::string operator_list;
+    for(auto& i : expressions.operators) {
+        operator_list += "\n            {" + aot_quote(i.name) + "," + std::to_string(i.type) + "," + std::to_string(i.priority) + "},";
+    }
+    std::string expression_uses;
+    for(auto& i : expressions.expressions) expression_uses += "\n            {{" + indices(i.literals) + "},{" + indices(i.operators) + "}},";
+
+    std::stringstream out;
+    out << "// generated by the carescript ahead of time compiler, don't edit\n";
+    out << "#include " << aot_quote(options.include) << "\n\n";
+    out << "CARESCRIPT_EXTENSION\n\n";
+    out << "namespace {\n\n";
+    out << "struct OperatorEntry {\n";
+    out << "    const char* name;\n";
+    out << "    int type;\n";
+    out << "    int priority;\n";
+    out << "};\n";
+    out << "struct ExpressionUses {\n";
+    out << "    std::vector<size_t> literals;\n";
+    out << "    std::vector<size_t> operators;\n";
+    out << "};\n\n";
+    out << "class CompiledExtension : public Extension {\n";
+    out << "    std::vector<ScriptBuiltin> builtins;\n";
+    out << "    std::vector<bool> has_builtin;\n";
+    out << "    std::vector<_operatorSite> sites;\n";
+    out << "public:\n";
+    out << "    std::vector<ScriptRawBuiltin> rawbuiltins;\n";
+    out << "    std::vector<ScriptVariable> literals;\n";
+    out << "    std::vector<_expressionToken> operators;\n";
+    out << "    // the expressions whose literals and operators are still the ones they were compiled with\n";
+    out << "    std::vector<bool> compiled;\n\n";
+    out << "    const ScriptBuiltin* builtin(size_t i) const noexcept { return has_builtin[i] ? &builtins[i] : nullptr; }\n\n";
+    out << "    const char* id() const noexcept override { return " << aot_quote(options.id) << "; }\n\n";
+    out << "    NativeLabelList get_native_labels() override;\n\n";
+    out << "    void poke_interpreter(Interpreter& interp) override {\n";
+    out << "        static const std::vector<std::string> builtin_names = {" << list(builtins) << "\n        };\n";
+    out << "        static const std::vector<std::string> rawbuiltin_names = {" << list(rawbuiltins) << "\n        };\n";
+    out << "        static const std::vector<KittenToken> literal_tokens = {" << literal_tokens << "\n        };\n";
+    out << "        static const std::vector<OperatorEntry> operator_list = {" << operator_list << "\n        };\n";
+    out << "        static const std::vector<ExpressionUses> expression_uses = {" << expression_uses << "\n        };\n";
+    out << "        for(auto& i : builtin_names) {\n";
+    out << "            has_builtin.push_back(interp.has_builtin(i));\n";
+    out << "            builtins.push_back(has_builtin.back() ? interp.get_builtin(i) : ScriptBuiltin{});\n";
+    out << "        }\n";
+    out << "        for(auto& i : rawbuiltin_names) {\n";
+    out << "            rawbuiltins.push_back(interp.has_rawbuiltin(i) ? interp.get_rawbuiltin(i) : ScriptRawBuiltin{});\n";
+    out << "        }\n";
+    out << "        std::vector<bool> valid;\n";
+    out << "        for(auto& i : literal_tokens) {\n";
+    out << "            literals.push_back(to_var(i,interp.settings));\n";
+    out << "            valid.push_back(aot_foldable(literals.back()));\n";
+    out << "        }\n";
+    out << "        // sites are never resized, the operators point at them\n";
+    out << "        sites.resize(operator_list.size());\n";
+    out << "        std::vector<bool> resolved;\n";
+    out << "        for(size_t i = 0; i < operator_list.size(); ++i) {\n";
+    out << "            const OperatorEntry& entry = operator_list[i];\n";
+    out << "            _expressionToken& token = operators.emplace_back();\n";
+    out << "            token.tk = entry.name;\n";
+    out << "            token.site = &sites[i];\n";
+    out << "            resolved.push_back(interp.script_operators.count(entry.name) != 0);\n";
+    out << "            if(!resolved.back()) continue;\n";
+    out << "            token.overloads = &interp.script_operators.at(entry.name);\n";
+    out << "            for(auto& o : *token.overloads) {\n";
+    out << "                if(o.type != entry.type) continue;\n";
+    out << "                if(token.candidates++ == 0) token.op = o;\n";
+    out << "                // it parses differently now\n";
+    out << "                if(o.priority != entry.priority) resolved.back() = false;\n";
+    out << "            }\n";
+    out << "            if(token.candidates == 0) resolved.back() = false;\n";
+    out << "        }\n";
+    out << "        for(auto& uses : expression_uses) {\n";
+    out << "            bool ok = true;\n";
+    out << "            for(auto i : uses.literals) ok = ok && valid[i];\n";
+    out << "            for(auto i : uses.operators) ok = ok && resolved[i];\n";
+    out << "            compiled.push_back(ok);\n";
+    out << "        }\n";
+    out << "    }\n";
+    out << "};\n\n";
+    out << expressions.functions.str();
+    out << steps.str();
+    out << "NativeLabelList CompiledExtension::get_native_labels() {\n";
+    out << "    return {\n" << natives.str() << "    };\n";
+    out << "}\n\n";
+    out << "} /* namespace */\n\n";
+    out << "CARESCRIPT_EXTENSION_GETEXT(\n";
+    out << "    return new CompiledExtension();\n";
+    out << ")\n";
+    return out.str();
+}
+
+} /* namespace carescript */
+
+#endif
@@ -7,5 +7,11 @@
 #include "carescript-parsing.hpp"
 #include "carescript-types.hpp"
 #include "carescript-defs.hpp"
+#include "carescript-lexer.hpp"
+#include "carescript-threads.hpp"
+#include "carescript-async.hpp"
+#include "carescript-program.hpp"
+#include "carescript-expression.hpp"
+#include "carescript-aot.hpp"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,211 @@
+#ifndef CARESCRIPT_ASYNC_HPP
+#define CARESCRIPT_ASYNC_HPP
+
+#include <coroutine>
+#include <chrono>
+#include <utility>
+
+#include "carescript-parsing.hpp"
+#include "carescript-threads.hpp"
+
+namespace carescript {
+
+// a label running as a C++20 coroutine. It suspends whenever a builtin has
+// to wait (see `cc_builtin_await`) and after every few statements, so other
+// tasks get a turn. Resume it directly or hand it to a `ScriptScheduler`
+class ScriptTask {
+public:
+    struct promise_type {
+        std::string error;
+        std::function<bool()> waiting;
+
+        ScriptTask get_return_object() noexcept {
+            return ScriptTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(std::string e) noexcept { error = std::move(e); }
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    ScriptTask(std::coroutine_handle<promise_type> h): handle(h) {}
+public:
+    ScriptTask() {}
+    ScriptTask(const ScriptTask&) = delete;
+    ScriptTask& operator=(const ScriptTask&) = delete;
+    ScriptTask(ScriptTask&& task) noexcept: handle(std::exchange(task.handle,nullptr)) {}
+    ScriptTask& operator=(ScriptTask&& task) noexcept {
+        if(this != &task) {
+            if(handle) handle.destroy();
+            handle = std::exchange(task.handle,nullptr);
+        }
+        return *this;
+    }
+    ~ScriptTask() {
+        if(handle) handle.destroy();
+    }
+
+    inline bool done() const noexcept { return !handle || handle.done(); }
+    // true if `resume` would make progress
+    inline bool ready() const noexcept {
+        return !done() && (!handle.promise().waiting || handle.promise().waiting());
+    }
+    // runs until the next suspension, returns false if the task isn't ready
+    inline bool resume() noexcept {
+        if(!ready()) return false;
+        handle.promise().waiting = nullptr;
+        handle.resume();
+        return true;
+    }
+    // runs the task to its end on this thread
+    inline std::string get() noexcept {
+        while(!done()) {
+            if(!resume()) script_wait_until([this]{ return ready(); });
+        }
+        return error();
+    }
+    // empty if the label ran without errors
+    inline std::string error() const noexcept {
+        return handle ? handle.promise().error : "";
+    }
+};
+
+// suspends a task until `ready` returns true
+struct _taskAwait {
+    std::function<bool()> ready;
+
+    bool await_ready() const noexcept { return !ready || ready(); }
+    void await_suspend(std::coroutine_handle<ScriptTask::promise_type> handle) noexcept {
+        handle.promise().waiting = std::move(ready);
+    }
+    void await_resume() const noexcept {}
+};
+
+template<typename... Targs>
+inline ScriptTask Interpreter::run_async(std::string label, Targs ...targs) {
+    std::vector<ScriptVariable> args = {targs...};
+    return run_async(label,args);
+}
+
+inline ScriptTask Interpreter::run_async(std::string label, std::vector<ScriptVariable> args, size_t slice) noexcept {
+    settings.set_return_value(script_null);
+    settings.line = 1;
+    settings.exit = false;
+    budget.start();
+
+    // every label runs in a deep frame, so a `call` doesn't need a C++ stack
+    // frame of its own and the task can suspend in any label it called
+    _frameStack stack;
+    stack.labels = shared_labels();
+    stack.slice = slice;
+    _scriptFrame& root = stack.push(&settings,true);
+    std::string error;
+    if(run_label_setup(root.frame,stack.codes,label,*stack.labels,settings,"",args,error)) {
+        while(true) {
+            // the task may continue on another thread
+            _frameStack* previous = _frameStack::current;
+            _frameStack::current = &stack;
+            error = stack.run(0);
+            _frameStack::current = previous;
+            if(!stack.suspended) break;
+            stack.suspended = false;
+            if(stack.waiting) {
+                output_sink->flush();
+                _taskAwait waiting{std::move(stack.waiting)};
+                stack.waiting = nullptr;
+                co_await waiting;
+                stack.top().settings->resumed = true;
+            }
+            else co_await std::suspend_always{};
+        }
+    }
+
+    settings.error_msg = error;
+    settings.exit = false;
+    output_sink->flush();
+    error_check();
+    co_return error;
+}
+
+// multiplexes many tasks onto a few threads. Every `poll` resumes each ready
+// task once, a task never runs on two threads at the same time.
+// `spawn` and `wake` may be called from any thread, `poll` and `run` only from one
+class ScriptScheduler {
+    struct _internalEntry {
+        ScriptTask task;
+        std::function<void(ScriptTask&)> on_done;
+    };
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool woken = false;
+    std::vector<_internalEntry> spawned;
+    std::vector<_internalEntry> tasks;
+    ScriptThreadPool pool;
+public:
+    ScriptScheduler(size_t threads = 1): pool(threads) {}
+
+    inline void spawn(ScriptTask task, std::function<void(ScriptTask&)> on_done = nullptr) noexcept {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            spawned.push_back({std::move(task),std::move(on_done)});
+        }
+        wake();
+    }
+
+    // makes a sleeping `run` check the tasks again, e.g. after `feed_input`
+    inline void wake() noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        woken = true;
+        wakeup.notify_all();
+    }
+
+    inline size_t size() noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        return tasks.size() + spawned.size();
+    }
+
+    // resumes every ready task once, returns how many of them ran
+    inline size_t poll() noexcept {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(auto& i : spawned) tasks.push_back(std::move(i));
+            spawned.clear();
+        }
+        std::vector<size_t> ready;
+        for(size_t i = 0; i < tasks.size(); ++i) {
+            if(tasks[i].task.ready()) ready.push_back(i);
+        }
+        pool.parallel_for(ready.size(),[&](size_t i) {
+            tasks[ready[i]].task.resume();
+        });
+
+        for(size_t i = 0; i < tasks.size();) {
+            if(!tasks[i].task.done()) {
+                ++i;
+                continue;
+            }
+            if(tasks[i].on_done) tasks[i].on_done(tasks[i].task);
+            std::swap(tasks[i],tasks.back());
+            tasks.pop_back();
+        }
+        return ready.size();
+    }
+
+    // polls until every task is done, sleeps while all of them are waiting
+    inline void run(std::chrono::milliseconds idle = std::chrono::milliseconds(1)) noexcept {
+        while(size() != 0) {
+            if(poll() != 0) continue;
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait_for(lock,idle,[this]{ return woken; });
+            woken = false;
+        }
+    }
+};
+
+} /* namespace carescript */
+
+#endif
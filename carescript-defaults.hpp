@@ -10,12 +10,22 @@
 
 namespace carescript {
 
+// a number from parsed text: integral values get the integer representation,
+// the rest is rounded to the precision of the number mode
+inline static ScriptNumberValue* _script_number(long double number, ScriptSettings& settings) noexcept {
+    if(_script_is_integral(number) && !(number == 0 && std::signbit(number))) {
+        return ScriptNumberValue::from_integer((long long)number);
+    }
+    if(settings.interpreter.number_mode == ScriptNumberMode::DOUBLE) number = (double)number;
+    return new ScriptNumberValue(number);
+}
+
 inline std::map<std::string,ScriptBuiltin> default_script_builtins = {
     {"set",{2,[](const ScriptArglist& args, ScriptSettings& settings)->ScriptVariable {
         cc_builtin_if_ignore();
         cc_builtin_var_requires(args[0],ScriptNameValue);
         cc_builtin_var_not_requires(args[1],ScriptNameValue);
-        settings.variables[get_value<ScriptNameValue>(args[0])] = args[1];
+        settings.set_variable(get_value<ScriptNameValue>(args[0]),args[1]);
         return script_null;
     }}},
     {"if",{1,[](const ScriptArglist& args, ScriptSettings& settings)->ScriptVariable {
@@ -48,24 +58,34 @@ inline std::map<std::string,ScriptBuiltin> default_script_builtins = {
     
     {"echo",{-1,[](const ScriptArglist& args, ScriptSettings& settings)->ScriptVariable {
         cc_builtin_if_ignore();
-        for(auto i : args) {
-            std::cout << i.printable();
+        ScriptOutput& out = settings.interpreter.output();
+        for(auto& i : args) {
+            out.print(i.printable());
         }
         return script_null;
     }}},
     {"echoln",{-1,[](const ScriptArglist& args, ScriptSettings& settings)->ScriptVariable {
         cc_builtin_if_ignore();
-        for(auto i : args) {
-            std::cout << i.printable();
+        ScriptOutput& out = settings.interpreter.output();
+        for(auto& i : args) {
+            out.print(i.printable());
         }
-        std::cout << "\n";
+        out.write("\n",1);
         return script_null;
     }}},
     {"input",{1,[](const ScriptArglist& args, ScriptSettings& settings)->ScriptVariable {
         cc_builtin_if_ignore();
         cc_builtin_var_requires(args[0],ScriptStringValue);
-        std::cout << get_value<ScriptStringValue>(args[0]); std::cout.flush();
         std::string inp;
+        if(settings.interpreter.queued_input) {
+            auto queue = settings.interpreter.get_input();
+            if(!settings.resumed) settings.interpreter.output().print(get_value<ScriptStringValue>(args[0]));
+            if(!queue->pop(inp)) cc_builtin_await([queue]{ return !queue->empty(); });
+            return new ScriptStringValue(inp);
+        }
+        ScriptOutput& out = settings.interpreter.output();
+        out.print(get_value<ScriptStringValue>(args[0]));
+        out.flush();
         std::getline(std::cin,inp);
         return new ScriptStringValue(inp);
     }}},
@@ -75,23 +95,22 @@ inline std::map<std::string,ScriptBuiltin> default_script_builtins = {
         cc_builtin_var_requires(args[0],ScriptNumberValue,ScriptStringValue);
         if(is_typeof<ScriptNumberValue>(args[0])) return args[0];
         long double num = 0;
-        std::string s = get_value<ScriptStringValue>(args[0]);
-        try {
-            std::size_t idx = 0;
-            num = std::stold(s,&idx);
-            if(idx != s.size()) throw 0;
-        }
-        catch(...) {
+        const std::string& s = ((const ScriptStringValue*)args[0].value.get())->string;
+        if(script_parse_number(s,num) == 0) {
             _cc_error("invalid input: \"" + s + "\"");
         }
 
-        return new ScriptNumberValue(num);
+        return _script_number(num,settings);
     }}},
     {"to_string",{1,[](const ScriptArglist& args, ScriptSettings& settings)->ScriptVariable {
         cc_builtin_if_ignore();
         cc_builtin_var_requires(args[0],ScriptNumberValue,ScriptStringValue);
         if(is_typeof<ScriptNumberValue>(args[0])) {
-            return new ScriptStringValue(std::to_string(get_value<ScriptNumberValue>(args[0])));
+            const long double number = get_value<ScriptNumberValue>(args[0]);
+            char buffer[64];
+            char* last = settings.interpreter.shortest_to_string ? script_format_number(buffer,sizeof(buffer),number) : _script_format_fixed6(buffer,sizeof(buffer),number,true);
+            if(last == nullptr) return new ScriptStringValue(std::to_string(number));
+            return new ScriptStringValue(std::string(buffer,last));
         }
         else if(is_typeof<ScriptStringValue>(args[0])) {
             return args[0];
@@ -119,6 +138,7 @@ inline std::map<std::string,ScriptBuiltin> default_script_builtins = {
         args2.erase(args.begin(),args.begin()+1);
 
         Interpreter interp;
+        interp.set_output(settings.interpreter.get_output());
         interp.script_builtins = settings.interpreter.script_builtins;
         interp.script_operators = settings.interpreter.script_operators;
         interp.script_typechecks = settings.interpreter.script_typechecks;
@@ -273,32 +293,96 @@ inline std::map<std::string,ScriptBuiltin> default_script_builtins = {
             _cc_error("requires at least one argument");
         }
         cc_builtin_var_requires(args[0],ScriptNameValue);
-        std::vector<ScriptVariable> run_args;
-        for(size_t i = 1; i < args.size(); ++i) {
-            // cc_builtin_var_requires(i,ScriptNameValue);
-            run_args.push_back(args[i]);
-        }
-        
-        if(settings.labels.count(get_value<ScriptNameValue>(args[0])) == 0) {
-            _cc_error("no such label " + get_value<ScriptNameValue>(args[0]));
+        const std::string& name = get_value<ScriptNameValue>(args[0]);
+        std::vector<ScriptVariable> run_args(args.begin() + 1,args.end());
+
+        const auto& labels = script_labels(settings);
+        auto label = labels.find(name);
+        if(label == labels.end()) {
+            _cc_error("no such label " + name);
         }
-        ScriptLabel label = settings.labels[get_value<ScriptNameValue>(args[0])];
-        if(label.arglist.size() > run_args.size()) {
+        if(label->second.arglist.size() > run_args.size()) {
             _cc_error("too few arguments");
         }
-        else if(label.arglist.size() < run_args.size()) {
+        else if(label->second.arglist.size() < run_args.size()) {
             _cc_error("too many arguments");
         }
-        ScriptSettings tset(settings.interpreter);
-        tset.constants = settings.constants;
-        settings.error_msg = run_label(get_value<ScriptNameValue>(args[0]),settings.labels,tset,"",run_args);
-        if(settings.error_msg != "") settings.raw_error = true;
-
-        return tset.return_value;
+        return script_call(name,run_args,settings);
+    }}},
+    // parallel_call(<variable>,<label>,<arguments...>,<variable>,<label>,<arguments...>,...)
+    // runs the labels at the same time on `Interpreter::thread_pool` and stores each return
+    // value in its variable. The output of the labels appears in the order they are listed,
+    // an error is reported like `call` does for the first of them that failed
+    {"parallel_call",{-1,[](const ScriptArglist& args, ScriptSettings& settings)->ScriptVariable {
+        cc_builtin_if_ignore();
+        struct _internalBranch {
+            std::string variable;
+            std::string label;
+            std::vector<ScriptVariable> args;
+            ScriptVariable result;
+            std::string error;
+            std::shared_ptr<ScriptStringOutput> output;
+        };
+        std::vector<_internalBranch> branches;
+        // one copy for all branches to run, see `script_labels`
+        const auto labels = script_shared_labels(settings);
+        for(size_t i = 0; i < args.size();) {
+            if(args.size() - i < 2) {
+                _cc_error("expected a variable and a label");
+            }
+            cc_builtin_var_requires(args[i],ScriptNameValue);
+            cc_builtin_var_requires(args[i + 1],ScriptNameValue);
+            _internalBranch& branch = branches.emplace_back();
+            branch.variable = get_value<ScriptNameValue>(args[i]);
+            branch.label = get_value<ScriptNameValue>(args[i + 1]);
+            auto label = labels->find(branch.label);
+            if(label == labels->end()) {
+                _cc_error("no such label " + branch.label);
+            }
+            i += 2;
+            // the label's parameters tell where the next call starts
+            const size_t count = label->second.arglist.size();
+            if(args.size() - i < count) {
+                _cc_error("too few arguments for " + branch.label);
+            }
+            branch.args.assign(args.begin() + i,args.begin() + i + count);
+            i += count;
+        }
+
+        Interpreter& interp = settings.interpreter;
+        ScriptThreadPool& pool = interp.thread_pool();
+        const bool shared = branches.size() > 1 && pool.size() > 1;
+        if(shared) ++interp.operator_cache.shared;
+        pool.parallel_for(branches.size(),[&](size_t i) {
+            _internalBranch& branch = branches[i];
+            if(interp.memo.lookup(branch.label,branch.args,branch.result)) return;
+            branch.output = std::make_shared<ScriptStringOutput>();
+            auto previous = interp.redirect_output(branch.output);
+            ScriptSettings tset(interp);
+            tset.constants = settings.constants;
+            branch.error = _run_label(branch.label,labels,tset,"",branch.args);
+            if(branch.error == "") interp.memo.store(branch.label,branch.args,tset.return_value);
+            branch.result = std::move(tset.return_value);
+            interp.redirect_output(std::move(previous));
+        });
+        if(shared) --interp.operator_cache.shared;
+
+        for(auto& branch : branches) {
+            if(branch.output != nullptr) interp.output().print(branch.output->string());
+            if(branch.error != "") {
+                settings.error_msg = branch.error;
+                settings.raw_error = true;
+                return script_null;
+            }
+        }
+        for(auto& branch : branches) {
+            if(!settings.set_variable(branch.variable,branch.result)) return script_null;
+        }
+        return script_null;
     }}},
     {"return",{1,[](const ScriptArglist& args, ScriptSettings& settings)->ScriptVariable {
         cc_builtin_if_ignore();
-        settings.return_value = args[0];
+        if(!settings.set_return_value(args[0])) return script_null;
         settings.exit = true;
         return script_null;
     }}},
@@ -311,11 +395,15 @@ inline std::map<std::string,ScriptBuiltin> default_script_builtins = {
         cc_builtin_var_requires(args[0],ScriptNameValue);
         cc_builtin_var_requires(args[1],ScriptNameValue);
         
-        ScriptVariable vr = settings.variables[get_value<ScriptNameValue>(args[1])];
-        if(is_typeof<ScriptStringValue>(vr)) {
+        // works on the stored string itself, modifications don't copy it
+        auto var = settings.variables.find(get_value<ScriptNameValue>(args[1]));
+        if(var == settings.variables.end() || is_null(var->second)) {
+            _cc_error("no variable named " + get_value<ScriptNameValue>(args[1]));
+        }
+        if(!is_typeof<ScriptStringValue>(var->second)) {
             _cc_error("requires string variable");
         }
-        std::string str = get_value<ScriptStringValue>(vr);
+        std::string& str = get_value<ScriptStringValue>(var->second);
 
         if(get_value<ScriptNameValue>(args[0]) == "ERASE") {
             if(args.size() != 3) _cc_error("requires 3 arguments");
@@ -325,8 +413,8 @@ inline std::map<std::string,ScriptBuiltin> default_script_builtins = {
             if(idx >= str.size()) _cc_error("index overflow");
             if(idx < 0) _cc_error("index undeflow");
 
-            str.erase(str.begin()+idx);
-            settings.variables[get_value<ScriptNameValue>(args[1])] = new ScriptStringValue(str);
+            settings.account(var->second.memory_usage(),var->second.memory_usage() - 1);
+            str.erase((size_t)idx,1);
         }
         else if(get_value<ScriptNameValue>(args[0]) == "INSERT") {
             if(args.size() != 4) _cc_error("requires 4 arguments");
@@ -337,8 +425,9 @@ inline std::map<std::string,ScriptBuiltin> default_script_builtins = {
             if(idx >= str.size()) _cc_error("index overflow");
             if(idx < 0) _cc_error("index undeflow");
 
-            str = str.substr(0,idx-1) + get_value<ScriptStringValue>(args[3]) + str.substr(idx,str.size()-1);
-            settings.variables[get_value<ScriptNameValue>(args[1])] = new ScriptStringValue(str);
+            const std::string& insert = ((const ScriptStringValue*)args[3].value.get())->string;
+            if(!settings.account(var->second.memory_usage(),var->second.memory_usage() + insert.size())) return script_null;
+            str.insert((size_t)idx,insert);
         }
         else if(get_value<ScriptNameValue>(args[0]) == "PUT") {
             if(args.size() != 4) _cc_error("requires 4 arguments");
@@ -349,8 +438,22 @@ inline std::map<std::string,ScriptBuiltin> default_script_builtins = {
             if(idx >= str.size()) _cc_error("index overflow");
             if(idx < 0) _cc_error("index undeflow");
             
-            str = str.substr(0,idx) + get_value<ScriptStringValue>(args[3]) + str.substr(idx+1,str.size()-1);
-            settings.variables[get_value<ScriptNameValue>(args[1])] = new ScriptStringValue(str);
+            const std::string& put = ((const ScriptStringValue*)args[3].value.get())->string;
+            if(!settings.account(var->second.memory_usage(),var->second.memory_usage() - 1 + put.size())) return script_null;
+            str.replace((size_t)idx,1,put);
+        }
+        // amortized O(1) per appended character, unlike set(s,$s + ...)
+        else if(get_value<ScriptNameValue>(args[0]) == "APPEND") {
+            if(args.size() < 3) _cc_error("requires at least 3 arguments");
+            size_t grow = 0;
+            for(size_t i = 2; i < args.size(); ++i) {
+                cc_builtin_var_requires(args[i],ScriptStringValue);
+                grow += ((const ScriptStringValue*)args[i].value.get())->string.size();
+            }
+            if(!settings.account(var->second.memory_usage(),var->second.memory_usage() + grow)) return script_null;
+            for(size_t i = 2; i < args.size(); ++i) {
+                str += ((const ScriptStringValue*)args[i].value.get())->string;
+            }
         }
         else if(get_value<ScriptNameValue>(args[0]) == "BACK") {
             if(args.size() != 2) _cc_error("requires 2 arguments");
@@ -361,7 +464,7 @@ inline std::map<std::string,ScriptBuiltin> default_script_builtins = {
         else if(get_value<ScriptNameValue>(args[0]) == "SIZE") {
             if(args.size() != 2) _cc_error("requires 2 arguments"); 
 
-            return new ScriptNumberValue((long double)str.size());
+            return script_number(str.size());
         }
         else if(get_value<ScriptNameValue>(args[0]) == "AT") {
             if(args.size() != 3) _cc_error("requires 3 arguments");
@@ -413,13 +516,11 @@ inline std::vector<ScriptTypeCheck> default_script_typechecks = {
         }
         return nullptr;
     },
-    [](KittenToken src,ScriptSettings&)->ScriptValue* {
+    [](KittenToken src,ScriptSettings& settings)->ScriptValue* {
         if(src.str) return nullptr;
-        try {
-            return new ScriptNumberValue(std::stold(src.src));
-        }
-        catch(...) {}
-        return nullptr;
+        long double number = 0;
+        if(script_parse_number(src.src,number,true) == 0) return nullptr;
+        return _script_number(number,settings);
     },
     [](KittenToken src,ScriptSettings&)->ScriptValue* {
         if(src.str) return nullptr;
@@ -443,46 +544,92 @@ inline std::vector<ScriptTypeCheck> default_script_typechecks = {
     },
 };
 
+inline static const ScriptNumberValue& _number_of(const ScriptVariable& var) noexcept {
+    return *(const ScriptNumberValue*)var.value.get();
+}
+
+// a number operator on the fastest representation that fits: `integer_op(l,r,result)`
+// runs if both sides are integers and returns false if the result doesn't fit
+// into an integer, then `float_op(l,r)` gets called with long doubles or doubles
+template<typename IntegerOp, typename FloatOp>
+inline static ScriptVariable _number_operator(const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings, IntegerOp integer_op, FloatOp float_op) noexcept {
+    const ScriptNumberValue& l = _number_of(left);
+    const ScriptNumberValue& r = _number_of(right);
+    long long result = 0;
+    if(l.is_integer && r.is_integer && integer_op(l.integer,r.integer,result)) {
+        return ScriptNumberValue::from_integer(result);
+    }
+    if(settings.interpreter.number_mode == ScriptNumberMode::DOUBLE) {
+        return new ScriptNumberValue(float_op((double)l.number,(double)r.number));
+    }
+    return new ScriptNumberValue(float_op(l.number,r.number));
+}
+
+// the integer halves of the default number operators, false if the result isn't an exact integer
+inline static bool _integer_add(long long l, long long r, long long& ret) noexcept { return !__builtin_add_overflow(l,r,&ret); }
+inline static bool _integer_sub(long long l, long long r, long long& ret) noexcept { return !__builtin_sub_overflow(l,r,&ret); }
+// 0 * -x is -0
+inline static bool _integer_mul(long long l, long long r, long long& ret) noexcept { return !__builtin_mul_overflow(l,r,&ret) && (ret != 0 || (l >= 0 && r >= 0)); }
+inline static bool _integer_div(long long l, long long r, long long& ret) noexcept {
+    // min / -1 overflows, and so does min % -1 on most machines
+    if((l == std::numeric_limits<long long>::min() && r == -1) || l % r != 0 || (l == 0 && r < 0)) return false;
+    ret = l / r;
+    return true;
+}
+inline static bool _integer_pow(long long l, long long r, long long& ret) noexcept {
+    if(r < 0) return false;
+    ret = 1;
+    for(; r != 0; r >>= 1) {
+        if((r & 1) && __builtin_mul_overflow(ret,l,&ret)) return false;
+        if(r > 1 && __builtin_mul_overflow(l,l,&l)) return false;
+    }
+    return true;
+}
+
+inline static ScriptVariable _script_bool(bool value) noexcept {
+    return ScriptNumberValue::from_integer(value);
+}
+
 inline std::map<std::string,std::vector<ScriptOperator>> default_script_operators = {
     {"+",{{0,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
         cc_operator_same_type(right,left,"+");
         cc_operator_var_requires(right,"+",ScriptNumberValue,ScriptStringValue);
         if(is_typeof<ScriptNumberValue>(right)) {
-            return new ScriptNumberValue(
-                    get_value<ScriptNumberValue>(left) + get_value<ScriptNumberValue>(right)
-                );
+            return _number_operator(left,right,settings,
+                _integer_add,
+                [](auto l, auto r) { return l + r; }
+            );
         }
         else {
-            return new ScriptStringValue(
-                    get_value<ScriptStringValue>(left) + get_value<ScriptStringValue>(right)
-                );
+            const std::string& l = ((const ScriptStringValue*)left.value.get())->string;
+            const std::string& r = ((const ScriptStringValue*)right.value.get())->string;
+            std::string str;
+            str.reserve(l.size() + r.size());
+            str += l;
+            str += r;
+            return new ScriptStringValue(std::move(str));
         }
     }}}},
     {"-",{{0,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
         cc_operator_same_type(right,left,"-");
         cc_operator_var_requires(right,"-",ScriptNumberValue);
-        ScriptVariable ret;
-        ret = new ScriptNumberValue(
-                get_value<ScriptNumberValue>(left) - get_value<ScriptNumberValue>(right)
-            );
-        return ret;
+        return _number_operator(left,right,settings,
+            _integer_sub,
+            [](auto l, auto r) { return l - r; }
+        );
     }},{-3,ScriptOperator::UNARY,[](const ScriptVariable& left, const ScriptVariable&, ScriptSettings& settings)->ScriptVariable {
         cc_operator_var_requires(left,"-",ScriptNumberValue);
-        ScriptVariable ret;
-        ret = new ScriptNumberValue(
-                get_value<ScriptNumberValue>(left) * -1
-            );
-        return ret;
+        const ScriptNumberValue& l = _number_of(left);
+        if(l.is_integer && l.integer != 0 && l.integer != std::numeric_limits<long long>::min()) return ScriptNumberValue::from_integer(-l.integer);
+        return new ScriptNumberValue(l.number * -1);
     }}}},
     {"*",{{-1,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
         cc_operator_same_type(right,left,"*");
         cc_operator_var_requires(right,"*",ScriptNumberValue);
-        ScriptVariable ret;
-        ret = new ScriptNumberValue(
-                get_value<ScriptNumberValue>(left) * get_value<ScriptNumberValue>(right)
-            );
-
-        return ret;
+        return _number_operator(left,right,settings,
+            _integer_mul,
+            [](auto l, auto r) { return l * r; }
+        );
     }}}},
     {"/",{{-1,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
         cc_operator_same_type(right,left,"/");
@@ -491,72 +638,62 @@ inline std::map<std::string,std::vector<ScriptOperator>> default_script_operator
             settings.error_msg = "/: division through 0 is not allowed";
             return script_null;
         }
-        ScriptVariable ret;
-        ret = new ScriptNumberValue(
-                get_value<ScriptNumberValue>(left) / get_value<ScriptNumberValue>(right)
-            );
-        return ret;
+        return _number_operator(left,right,settings,
+            _integer_div,
+            [](auto l, auto r) { return l / r; }
+        );
     }}}},
     {"^",{{-2,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
         cc_operator_same_type(right,left,"^");
         cc_operator_var_requires(right,"^",ScriptNumberValue);
-        ScriptVariable ret;
-        ret = new ScriptNumberValue(
-                std::pow(get_value<ScriptNumberValue>(left), get_value<ScriptNumberValue>(right))
-            );
-        return ret;
+        return _number_operator(left,right,settings,
+            _integer_pow,
+            [](auto l, auto r) { return std::pow(l,r); }
+        );
     }}}},
     
     {"is",{{2,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
         cc_operator_same_type(right,left,"is");
 
-        return new ScriptNumberValue(
-                left == right ? true : false
-            );
+        return _script_bool(left == right);
     }}}},
     {"isnt",{{2,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
         cc_operator_same_type(right,left,"isnt");
 
-        return new ScriptNumberValue(
-                left == right ? false : true
-            );
+        return _script_bool(!(left == right));
     }}}},
     {"and",{{3,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
         cc_operator_same_type(right,left,"and");
         cc_operator_var_requires(right,"and",ScriptNumberValue);
         
-        return new ScriptNumberValue(
-                (get_value<ScriptNumberValue>(left) == true && get_value<ScriptNumberValue>(right)) ? true : false
-            );
+        return _script_bool(get_value<ScriptNumberValue>(left) == true && get_value<ScriptNumberValue>(right));
     }}}},
     {"or",{{4,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
         cc_operator_same_type(right,left,"or");
         cc_operator_var_requires(right,"or",ScriptNumberValue);
                 
-        return new ScriptNumberValue(
-                (get_value<ScriptNumberValue>(left) == true || get_value<ScriptNumberValue>(right) == true) ? true : false
-            );
+        return _script_bool(get_value<ScriptNumberValue>(left) == true || get_value<ScriptNumberValue>(right) == true);
     }}}},
     {"more",{{5,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
         cc_operator_same_type(right,left,"more");
         cc_operator_var_requires(right,"more",ScriptNumberValue);
-        return new ScriptNumberValue(
-                (get_value<ScriptNumberValue>(left) > get_value<ScriptNumberValue>(right)) ? true : false
-            );
+        const ScriptNumberValue& l = _number_of(left);
+        const ScriptNumberValue& r = _number_of(right);
+        if(l.is_integer && r.is_integer) return _script_bool(l.integer > r.integer);
+        return _script_bool(l.number > r.number);
     }}}},
     {"less",{{5,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
         cc_operator_same_type(right,left,"less");
         cc_operator_var_requires(right,"less",ScriptNumberValue);
-        return new ScriptNumberValue(
-                (get_value<ScriptNumberValue>(left) < get_value<ScriptNumberValue>(right)) ? true : false
-            );
+        const ScriptNumberValue& l = _number_of(left);
+        const ScriptNumberValue& r = _number_of(right);
+        if(l.is_integer && r.is_integer) return _script_bool(l.integer < r.integer);
+        return _script_bool(l.number < r.number);
     }}}},
     
     {"not",{{-4,ScriptOperator::UNARY,[](const ScriptVariable& left, const ScriptVariable&, ScriptSettings& settings)->ScriptVariable {
         cc_operator_var_requires(left,"not",ScriptNumberValue);
-        return new ScriptNumberValue(
-                !get_value<ScriptNumberValue>(left)
-            );
+        return _script_bool(!get_value<ScriptNumberValue>(left));
     }}}},
     {"$",{{-5,ScriptOperator::UNARY,[](const ScriptVariable& left, const ScriptVariable&, ScriptSettings& settings)->ScriptVariable {
         cc_operator_var_requires(left,"$",ScriptNameValue);
@@ -592,6 +729,30 @@ inline std::unordered_map<std::string,std::string> default_script_macros = {
 #endif
 };
 
+inline std::unordered_map<std::string,ScriptPreProcess> default_script_preprocesses = {
+    // @pragma memoize <label> [size], see `ScriptMemo`
+    {"memoize",[](const lexed_kittens& args, std::vector<lexed_kittens>&, size_t, ScriptSettings& settings) {
+        if(args.size() != 1 && args.size() != 2) {
+            settings.error_msg = "memoize: expected a label and an optional size";
+            return;
+        }
+        if(args[0].str || !is_name(args[0].src)) {
+            settings.error_msg = "memoize: invalid label name: " + args[0].src;
+            return;
+        }
+        size_t size = 1024;
+        if(args.size() == 2) {
+            long double number = 0;
+            if(args[1].str || script_parse_number(args[1].src,number) == 0 || !_script_is_integral(number) || number < 0) {
+                settings.error_msg = "memoize: invalid size: " + args[1].src;
+                return;
+            }
+            size = (size_t)number;
+        }
+        settings.interpreter.memo.memoize(args[0].src,size);
+    }},
+};
+
 } /* namespace carescript */
 
 #endif
\ No newline at end of file
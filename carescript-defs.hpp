@@ -7,15 +7,41 @@
 #include <vector>
 #include <stack>
 #include <unordered_map>
+#include <unordered_set>
 #include <filesystem>
 #include <exception>
 #include <functional>
 #include <any>
+#include <memory>
+#include <iostream>
+#include <cstdio>
+#include <mutex>
+#include <algorithm>
+#include <deque>
+#include <list>
+#include <thread>
+#include <chrono>
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <span>
+#include <atomic>
+#include <typeinfo>
+#include <typeindex>
+
+#if defined(__linux__)
+# include <sys/uio.h>
+# include <unistd.h>
+# include <cerrno>
+#endif
 
 #include "catpkgs/kittenlexer/kittenlexer.hpp"
 
+#include "carescript-lexer.hpp"
 #include "carescript-types.hpp"
 #include "carescript-macromagic.hpp"
+#include "carescript-threads.hpp"
 
 namespace carescript {
 
@@ -36,6 +62,7 @@ struct ScriptVariable {
     ScriptVariable(const ScriptVariable& var) {
         if(var.value.get() != nullptr) value.reset(var.value->copy());
     }
+    ScriptVariable(ScriptVariable&& var) noexcept = default;
 
     template<typename Tp>
     ScriptVariable(Tp a) {
@@ -51,10 +78,24 @@ struct ScriptVariable {
         if(var.value.get() != nullptr) value.reset(var.value->copy());
         return *this;
     }
+    // takes the value over instead of copying it
+    inline ScriptVariable& operator=(ScriptVariable&& var) noexcept {
+        if(var.value.get() != nullptr) value = std::move(var.value);
+        return *this;
+    }
 
     inline std::string get_type() const noexcept {
         return value.get()->get_type();
     }
+    inline size_t type_id() const noexcept {
+        return value.get()->type_id();
+    }
+    inline size_t memory_usage() const noexcept {
+        return value.get() == nullptr ? 0 : value->memory_usage();
+    }
+    inline size_t hash() const noexcept {
+        return value.get() == nullptr ? 0 : value->hash();
+    }
     inline std::string printable() const noexcept{
         return value.get()->to_printable();
     }
@@ -75,8 +116,13 @@ struct ScriptVariable {
 // checks if a variable has a specific type
 template<ScriptValueType Tval>
 inline static bool is_typeof(const carescript::ScriptVariable& var) noexcept {
-    Tval inst;
-    return var.get_type() == inst.get_type();
+    if constexpr(requires { Tval::static_type_id; }) {
+        return var.type_id() == Tval::static_type_id;
+    }
+    else {
+        Tval inst;
+        return var.type_id() == inst.type_id();
+    }
 }
 
 // checks if two subclasses of ScriptValue are the same
@@ -89,7 +135,7 @@ inline static bool is_same_type() noexcept {
 
 // checks if two ScriptVariable instances have the same type
 inline static bool is_same_type(const ScriptVariable& v1,const ScriptVariable& v2) noexcept {
-    return v1.get_type() == v2.get_type();
+    return v1.type_id() == v2.type_id();
 }
 
 // checks if a variable is null
@@ -109,11 +155,112 @@ inline static auto& get_value(carescript::ScriptVariable& v) noexcept {
 
 // modify only if you know what you're doing
 inline static ScriptVariable script_null = new ScriptNullValue();
-inline static ScriptVariable script_true = new ScriptNumberValue(true);
-inline static ScriptVariable script_false = new ScriptNumberValue(false);
+inline static ScriptVariable script_true = ScriptNumberValue::from_integer(1);
+inline static ScriptVariable script_false = ScriptNumberValue::from_integer(0);
+
+// hands out the slot index of every type stored in `ScriptSlots`.
+// Shared by the interpreters of a process, extensions reach it through
+// the interpreter so a library doesn't end up with its own
+class ScriptSlotRegistry {
+    std::mutex mutex;
+    std::unordered_map<std::type_index,size_t> indices;
+public:
+    // types are the same in every library, those with internal linkage
+    // (e.g. in an anonymous namespace) only in the one they come from
+    inline size_t index(const std::type_info& type) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        return indices.emplace(type,indices.size()).first->second;
+    }
+};
+
+inline ScriptSlotRegistry& script_slot_registry() noexcept {
+    static ScriptSlotRegistry registry;
+    return registry;
+}
+
+// per interpreter state of extensions, one default constructed value per type.
+// The index of a type is looked up once per library, every later access is a
+// vector index. Creating a value isn't thread safe, using existing ones is
+class ScriptSlots {
+    struct _internalSlot {
+        void* value = nullptr;
+        void(*destroy)(void*) = nullptr;
+        void*(*copy)(const void*) = nullptr;
+    };
+    template<typename T>
+    struct _internalIndex {
+        inline static std::atomic<size_t> index = SIZE_MAX;
+    };
+
+    std::vector<_internalSlot> slots;
+    ScriptSlotRegistry* registry = &script_slot_registry();
+
+    template<typename T>
+    inline T& _create(size_t index) noexcept {
+        if(slots.size() <= index) slots.resize(index + 1);
+        _internalSlot& slot = slots[index];
+        slot.value = new T();
+        slot.destroy = [](void* value) { delete (T*)value; };
+        slot.copy = [](const void* value)->void* { return new T(*(const T*)value); };
+        return *(T*)slot.value;
+    }
+public:
+    ScriptSlots() {}
+    ScriptSlots(const ScriptSlots& other) { *this = other; }
+    ScriptSlots& operator=(const ScriptSlots& other) {
+        if(this == &other) return *this;
+        clear();
+        registry = other.registry;
+        slots.resize(other.slots.size());
+        for(size_t i = 0; i < slots.size(); ++i) {
+            if(other.slots[i].value == nullptr) continue;
+            slots[i] = other.slots[i];
+            slots[i].value = other.slots[i].copy(other.slots[i].value);
+        }
+        return *this;
+    }
+    ~ScriptSlots() { clear(); }
+
+    template<typename T>
+    inline size_t index() noexcept {
+        size_t ret = _internalIndex<T>::index.load(std::memory_order_relaxed);
+        if(ret == SIZE_MAX) {
+            ret = registry->index(typeid(T));
+            _internalIndex<T>::index.store(ret,std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+    // the value of type `T`, created on first access
+    template<typename T>
+    inline T& get() noexcept {
+        const size_t i = index<T>();
+        if(i < slots.size() && slots[i].value != nullptr) return *(T*)slots[i].value;
+        return _create<T>(i);
+    }
+    // nullptr if there is no value of type `T` yet
+    template<typename T>
+    inline T* find() noexcept {
+        const size_t i = index<T>();
+        return i < slots.size() ? (T*)slots[i].value : nullptr;
+    }
+    template<typename T>
+    inline void erase() noexcept {
+        const size_t i = index<T>();
+        if(i >= slots.size() || slots[i].value == nullptr) return;
+        slots[i].destroy(slots[i].value);
+        slots[i] = _internalSlot();
+    }
+
+    inline void clear() noexcept {
+        for(auto& i : slots) if(i.value != nullptr) i.destroy(i.value);
+        slots.clear();
+    }
+};
 
 struct Interpreter;
 struct ScriptLabel;
+struct _scriptFrame;
 // general storage class for the current state of execution
 struct ScriptSettings {
     Interpreter& interpreter;
@@ -122,7 +269,10 @@ struct ScriptSettings {
     std::stack<bool> should_run;
     std::map<std::string,ScriptVariable> variables;
     std::map<std::string,ScriptVariable> constants;
+    // the labels of the run, `script_labels` gets them without copying
     std::map<std::string,ScriptLabel> labels;
+    // `labels` is a copy of this, see `_frameStack::share_labels`
+    std::shared_ptr<const std::map<std::string,ScriptLabel>> labels_of;
     std::filesystem::path parent_path;
     int ignore_endifs = 0;
     ScriptVariable return_value = script_null;
@@ -131,25 +281,49 @@ struct ScriptSettings {
     bool raw_error = false;
     std::stack<std::string> label;
 
+    // kept until `clear()`, prefer `slot<T>()` for state accessed often
     std::map<std::string,std::any> storage;
+    // the interpreter's value of type `T` (see `ScriptSlots`),
+    // kept until `Interpreter::clear()`
+    template<typename T>
+    inline T& slot() noexcept;
+
+    // bytes of the variables, constants and return value above counted in
+    // `Interpreter::memory`, copies of the settings don't count them again
+    struct _internalAccounted {
+        size_t bytes = 0;
+        _internalAccounted() {}
+        _internalAccounted(const _internalAccounted&) {}
+        _internalAccounted& operator=(const _internalAccounted&) { return *this; }
+    } accounted;
+
+    // set by a builtin that has to wait for something (see `cc_builtin_await`),
+    // the statement gets run again once it returns true
+    std::function<bool()> await;
+    // true while a statement runs again after waiting
+    bool resumed = false;
+    // the frame running with these settings, see `_frameStack::frame_of`
+    struct _internalFrame {
+        _scriptFrame* frame = nullptr;
+        _internalFrame() {}
+        _internalFrame(const _internalFrame&) {}
+        _internalFrame& operator=(const _internalFrame&) { return *this; }
+    } running;
 
     ScriptSettings(Interpreter& i): interpreter(i) {}
-
-    inline void clear() noexcept {
-        line = 0;
-        exit = false;
-        should_run = std::stack<bool>();
-        variables.clear();
-        constants.clear();
-        labels.clear();
-        parent_path = "";
-        ignore_endifs = 0;
-        return_value = script_null;
-        error_msg = "";
-        raw_error = false;
-        label = std::stack<std::string>();
-        storage.clear();
-    }
+    inline ~ScriptSettings();
+
+    // store a value and count its memory, these return false and set
+    // `error_msg` (storing nothing) if the interpreter's memory limit is reached
+    inline bool set_variable(const std::string& name, const ScriptVariable& value) noexcept;
+    inline bool set_constant(const std::string& name, const ScriptVariable& value) noexcept;
+    inline bool set_return_value(const ScriptVariable& value) noexcept;
+    inline void erase_variable(const std::string& name) noexcept;
+    inline void erase_constant(const std::string& name) noexcept;
+    // for values that changed in place, from `old_bytes` to `new_bytes`
+    inline bool account(size_t old_bytes, size_t new_bytes) noexcept;
+
+    inline void clear() noexcept;
 };
 
 // storage class for an operator
@@ -160,6 +334,112 @@ struct ScriptOperator {
     enum {UNARY, BINARY, UNKNOWN} type;
     // if UNARY, `right` will always be script_null
     ScriptVariable(*run)(const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings) = nullptr;
+    // `type_id()` of the operands this overload is for, 0 takes any type.
+    // Overloads never get called with operands of other types
+    size_t left_type = 0;
+    size_t right_type = 0;
+};
+
+// the overload an operator in an expression picked for the operand types it saw last
+struct _operatorSite {
+    const std::vector<ScriptOperator>* overloads = nullptr;
+    size_t index = 0;
+    size_t left = 0;
+    size_t right = 0;
+    ScriptVariable(*run)(const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings) = nullptr;
+};
+
+// the operator sites of every evaluated expression, keyed by its source, and
+// the overloads of every operator by operand types.
+// Lets operators skip overloads that don't fit the operands (see `expression_apply`).
+// Tables notice overloads being added, call `clear` after replacing one in place
+struct ScriptOperatorCache {
+    struct _internalKey {
+        size_t left = 0;
+        size_t right = 0;
+        int type = 0;
+        int priority = 0;
+
+        bool operator==(const _internalKey&) const = default;
+    };
+    struct _internalKeyHash {
+        size_t operator()(const _internalKey& key) const noexcept {
+            size_t ret = key.left * 0x9E3779B97F4A7C15ull;
+            ret ^= key.right + 0x9E3779B97F4A7C15ull + (ret << 6) + (ret >> 2);
+            return ret ^ ((size_t)key.type << 32) ^ (size_t)(unsigned)key.priority;
+        }
+    };
+    using _internalCandidates = std::shared_ptr<const std::vector<size_t>>;
+    struct _internalTable {
+        size_t size = 0;
+        std::unordered_map<_internalKey,_internalCandidates,_internalKeyHash> candidates;
+    };
+
+    // keyed by the overload list in `Interpreter::script_operators`
+    std::unordered_map<const std::vector<ScriptOperator>*,_internalTable> tables;
+    std::unordered_map<std::string,std::vector<_operatorSite>> sites;
+    // expressions beyond this many aren't cached
+    size_t max_expressions = 4096;
+    // number of `parallel_call`s running. Sites are written without a lock,
+    // so expressions don't get any while labels run in parallel
+    std::atomic<size_t> shared = 0;
+    std::mutex mutex;
+
+    // the tables and sites of a copy would point into the original, so copies start empty
+    ScriptOperatorCache() {}
+    ScriptOperatorCache(const ScriptOperatorCache& cache): max_expressions(cache.max_expressions) {}
+    ScriptOperatorCache& operator=(const ScriptOperatorCache& cache) {
+        clear();
+        max_expressions = cache.max_expressions;
+        return *this;
+    }
+
+    inline static _internalCandidates _matching(const std::vector<ScriptOperator>& overloads, const _internalKey& key) noexcept {
+        auto ret = std::make_shared<std::vector<size_t>>();
+        for(size_t i = 0; i < overloads.size(); ++i) {
+            const ScriptOperator& o = overloads[i];
+            if(o.type != key.type || o.priority != key.priority) continue;
+            if((o.left_type == 0 || o.left_type == key.left) && (o.right_type == 0 || o.right_type == key.right)) ret->push_back(i);
+        }
+        return ret;
+    }
+
+    // (re)builds the table of an operator for every pair of declared operand types,
+    // done whenever an extension adds overloads
+    inline void build(const std::vector<ScriptOperator>& overloads) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        _build(overloads);
+    }
+    inline _internalTable& _build(const std::vector<ScriptOperator>& overloads) noexcept {
+        _internalTable& table = tables[&overloads];
+        table = _internalTable();
+        table.size = overloads.size();
+        for(auto& i : overloads) {
+            if(i.left_type == 0 || i.right_type == 0) continue;
+            _internalKey key{i.left_type,i.right_type,i.type,i.priority};
+            if(table.candidates.count(key) == 0) table.candidates.emplace(key,_matching(overloads,key));
+        }
+        return table;
+    }
+
+    // indices of the overloads with the type and priority of `op` that take
+    // operands of these types, in the order they were added. Stays valid
+    // when the table gets rebuilt
+    inline _internalCandidates candidates(const std::vector<ScriptOperator>& overloads, const ScriptOperator& op, size_t left, size_t right) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = tables.find(&overloads);
+        _internalTable& table = found == tables.end() || found->second.size != overloads.size() ? _build(overloads) : found->second;
+        const _internalKey key{left,right,op.type,op.priority};
+        auto entry = table.candidates.find(key);
+        if(entry == table.candidates.end()) entry = table.candidates.emplace(key,_matching(overloads,key)).first;
+        return entry->second;
+    }
+
+    inline void clear() noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        tables.clear();
+        sites.clear();
+    }
 };
 
 using ScriptArglist = std::vector<ScriptVariable>;
@@ -178,6 +458,144 @@ struct ScriptBuiltin {
     ScriptVariable(*exec)(const ScriptArglist&,ScriptSettings&);
 };
 
+// how a C++ parameter of a builtin made with `make_builtin` is taken from its
+// argument. `value_type` is the required type (void: any), `get` unwraps it
+// without copying. Specialize it to bind your own parameter types
+template<typename Tp>
+struct ScriptArgument;
+
+template<typename Tp> requires std::is_arithmetic_v<Tp>
+struct ScriptArgument<Tp> {
+    using value_type = ScriptNumberValue;
+    static inline Tp get(const ScriptVariable& var) noexcept {
+        const ScriptNumberValue* num = (const ScriptNumberValue*)var.value.get();
+        if constexpr(std::is_integral_v<Tp>) {
+            if(num->is_integer) return (Tp)num->integer;
+        }
+        return (Tp)num->number;
+    }
+};
+template<>
+struct ScriptArgument<std::string> {
+    using value_type = ScriptStringValue;
+    static inline const std::string& get(const ScriptVariable& var) noexcept { return ((const ScriptStringValue*)var.value.get())->string; }
+};
+template<ScriptValueType Tp>
+struct ScriptArgument<Tp> {
+    using value_type = Tp;
+    static inline const Tp& get(const ScriptVariable& var) noexcept { return *(const Tp*)var.value.get(); }
+};
+template<>
+struct ScriptArgument<ScriptVariable> {
+    using value_type = void;
+    static inline const ScriptVariable& get(const ScriptVariable& var) noexcept { return var; }
+};
+
+template<typename Sig>
+struct _builtinSignature;
+template<typename R, typename... A>
+struct _builtinSignature<R(*)(A...)> { using type = R(A...); };
+template<typename R, typename C, typename... A>
+struct _builtinSignature<R(C::*)(A...) const> { using type = R(A...); };
+template<typename R, typename C, typename... A>
+struct _builtinSignature<R(C::*)(A...) const noexcept> { using type = R(A...); };
+template<typename R, typename... A>
+struct _builtinSignature<R(*)(A...) noexcept> { using type = R(A...); };
+template<typename Fn> requires std::is_class_v<Fn>
+struct _builtinSignature<Fn>: _builtinSignature<decltype(&Fn::operator())> {};
+
+template<typename Sig, typename Callable>
+struct _builtinBinding;
+template<typename R, typename... A, typename Callable>
+struct _builtinBinding<R(A...),Callable> {
+    template<typename P>
+    static constexpr bool is_settings = std::is_same_v<std::remove_cvref_t<P>,ScriptSettings>;
+
+    // position of every parameter in the argument list
+    static constexpr std::array<size_t,sizeof...(A)> indices = []() {
+        std::array<size_t,sizeof...(A)> ret{};
+        size_t param = 0, arg = 0;
+        ((ret[param++] = is_settings<A> ? 0 : arg++), ...);
+        return ret;
+    }();
+    static constexpr int arg_count = (0 + ... + (is_settings<A> ? 0 : 1));
+
+    template<size_t I>
+    static inline bool check(const ScriptArglist& args, ScriptSettings& settings) noexcept {
+        using P = std::remove_cvref_t<std::tuple_element_t<I,std::tuple<A...>>>;
+        if constexpr(is_settings<P>) return true;
+        else {
+            static_assert(!std::is_lvalue_reference_v<std::tuple_element_t<I,std::tuple<A...>>> || 
+                std::is_const_v<std::remove_reference_t<std::tuple_element_t<I,std::tuple<A...>>>>,
+                "builtin arguments can only be taken by value or const reference");
+            using V = typename ScriptArgument<P>::value_type;
+            if constexpr(std::is_void_v<V>) return true;
+            else {
+                if(is_typeof<V>(args[indices[I]])) return true;
+                settings.error_msg = "argument " + std::to_string(indices[I]) + " does not match type " + V().get_type() + " (got: " + args[indices[I]].get_type() + ")";
+                return false;
+            }
+        }
+    }
+
+    template<size_t I>
+    static inline decltype(auto) get(const ScriptArglist& args, ScriptSettings& settings) noexcept {
+        using P = std::remove_cvref_t<std::tuple_element_t<I,std::tuple<A...>>>;
+        if constexpr(is_settings<P>) return (settings);
+        else return ScriptArgument<P>::get(args[indices[I]]);
+    }
+
+    template<size_t... I>
+    static inline ScriptVariable call(const ScriptArglist& args, ScriptSettings& settings, std::index_sequence<I...>) noexcept {
+        if(!(check<I>(args,settings) && ...)) return script_null;
+        if constexpr(std::is_void_v<R>) {
+            Callable{}(get<I>(args,settings)...);
+            return script_null;
+        }
+        else if constexpr(std::is_same_v<R,ScriptVariable>) return Callable{}(get<I>(args,settings)...);
+        else if constexpr(std::is_same_v<R,bool>) return Callable{}(get<I>(args,settings)...) ? script_true : script_false;
+        else if constexpr(std::is_arithmetic_v<R>) return script_number(Callable{}(get<I>(args,settings)...));
+        else if constexpr(std::is_same_v<R,std::string>) return new ScriptStringValue(Callable{}(get<I>(args,settings)...));
+        else if constexpr(std::is_pointer_v<R>) return (ScriptValue*)Callable{}(get<I>(args,settings)...);
+        else return new R(Callable{}(get<I>(args,settings)...));
+    }
+
+    static ScriptVariable exec(const ScriptArglist& args, ScriptSettings& settings) {
+        cc_builtin_if_ignore();
+        return call(args,settings,std::index_sequence_for<A...>{});
+    }
+};
+
+template<auto Fn>
+struct _builtinFunction {
+    template<typename... A>
+    decltype(auto) operator()(A&&... args) const { return std::invoke(Fn,std::forward<A>(args)...); }
+};
+
+// makes a builtin out of a C++ function. The argument count and type checks
+// come from its parameters, a `ScriptSettings&` parameter gets the settings.
+// Numbers and strings are passed directly (strings by const reference without a copy),
+// return values are wrapped into a ScriptVariable (void returns null).
+//   make_builtin<&function>()
+//   make_builtin([](long double a, long double b) { return a * b; })
+//   make_builtin<long double(long double,const std::string&)>([](long double a, const std::string& b) { ... })
+// Lambdas may not capture, as `ScriptBuiltin::exec` is a plain function pointer
+template<auto Fn>
+inline static ScriptBuiltin make_builtin() noexcept {
+    using sig = typename _builtinSignature<decltype(Fn)>::type;
+    using binding = _builtinBinding<sig,_builtinFunction<Fn>>;
+    return ScriptBuiltin{binding::arg_count,binding::exec};
+}
+template<typename Sig, typename Fn> requires std::is_function_v<Sig> && std::is_empty_v<Fn> && std::is_default_constructible_v<Fn>
+inline static ScriptBuiltin make_builtin(Fn) noexcept {
+    using binding = _builtinBinding<Sig,Fn>;
+    return ScriptBuiltin{binding::arg_count,binding::exec};
+}
+template<typename Fn> requires std::is_empty_v<Fn> && std::is_default_constructible_v<Fn>
+inline static ScriptBuiltin make_builtin(Fn fn) noexcept {
+    return make_builtin<typename _builtinSignature<Fn>::type>(fn);
+}
+
 // storage class for a label
 struct ScriptLabel {
     std::vector<std::string> arglist;
@@ -202,16 +620,195 @@ inline static bool bake_extension(ExtensionData extension, ScriptSettings& setti
 // runs a "main" function of a script
 inline static std::string run_script(const std::string& source, ScriptSettings& settings) noexcept;
 // runs a specific label with the given parameters
-inline static std::string run_label(const std::string& label_name, std::map<std::string,ScriptLabel> labels, ScriptSettings& settings, const std::filesystem::path& parent_path, const std::vector<ScriptVariable>& args) noexcept;
+inline static std::string run_label(const std::string& label_name, const std::map<std::string,ScriptLabel>& labels, ScriptSettings& settings, const std::filesystem::path& parent_path, const std::vector<ScriptVariable>& args) noexcept;
+inline static std::string _run_label(const std::string& label_name, std::shared_ptr<const std::map<std::string,ScriptLabel>> labels, ScriptSettings& settings, const std::filesystem::path& parent_path, const std::vector<ScriptVariable>& args) noexcept;
+struct _frameStack;
+// `run_label` for `Interpreter::run`. If the budget stops it, its frames are kept in `preempted`
+// and `run_preempted` continues them (`preempted` is reset once they're done)
+inline static std::string run_label_preemptible(const std::string& label_name, ScriptSettings& settings, const std::vector<ScriptVariable>& args, std::unique_ptr<_frameStack>& preempted) noexcept;
+inline static std::string run_preempted(ScriptSettings& settings, std::unique_ptr<_frameStack>& preempted) noexcept;
+// runs a label like `call` does from a statement run with `settings`, the result of
+// the label is returned and its error goes into `settings.error_msg`
+inline static ScriptVariable script_call(const std::string& label_name, const std::vector<ScriptVariable>& args, ScriptSettings& settings) noexcept;
+// the labels `call` can reach from a statement run with `settings`,
+// the same as `settings.labels` but without a copy of them
+inline static const std::map<std::string,ScriptLabel>& script_labels(const ScriptSettings& settings) noexcept;
+// `script_labels` for labels that run on other threads, only copied if they aren't shared already
+inline static std::shared_ptr<const std::map<std::string,ScriptLabel>> script_shared_labels(ScriptSettings& settings) noexcept;
+
+enum class _statementResult { NEXT, DONE, FAILED, AWAIT };
+struct _labelFrame;
+
+// a label compiled to C++ (see carescript-aot.hpp). `step` runs the statement
+// at `settings.line`, it's only used if `hash` matches the pre processed label
+struct ScriptNativeLabel {
+    size_t hash = 0;
+    _statementResult(*step)(_labelFrame& frame, ScriptSettings& settings, std::string& error) = nullptr;
+    // handed to `step` through `frame.native`
+    void* data = nullptr;
+};
+
+// a label split into its statements, made once per run for every label it uses
+struct _labelCode {
+    std::vector<lexed_kittens> lines;
+    ScriptNativeLabel native;
+    // set if one of the lines isn't a statement
+    std::string error;
+};
+using _labelCodes = std::unordered_map<std::string,_labelCode>;
+
+// a label that is being run, see `run_label_setup` and `run_label_step`.
+// The label and its lines belong to the labels and `_labelCodes` it was set up with
+struct _labelFrame {
+    std::string name;
+    const ScriptLabel* label = nullptr;
+    std::span<const lexed_kittens> lines;
+    ScriptNativeLabel native;
+};
+
+// a label run by `_frameStack`
+struct _scriptFrame {
+    _labelFrame frame;
+    _frameStack* stack = nullptr;
+    // `own` for labels started by `call`, kept for the next label at this depth
+    ScriptSettings* settings = nullptr;
+    std::unique_ptr<ScriptSettings> own;
+    // arguments of the label, for `Interpreter::memo`
+    std::vector<ScriptVariable> args;
+    // deep frames don't get their own C++ stack frame for a `call`, the label
+    // runs after the statement gave up and the statement runs again afterwards.
+    // `results` are the calls (and other builtins) that statement already made,
+    // in the order it made them, `next_result` is the next one to hand out
+    bool deep = false;
+    struct _internalResult {
+        ScriptVariable value;
+        std::string error;
+    };
+    std::vector<_internalResult> results;
+    size_t next_result = 0;
+
+    // steps of the statement count again once all results are handed out
+    inline bool replaying() const noexcept { return next_result < results.size(); }
+    inline _internalResult& replay() noexcept { return results[next_result++]; }
+    inline void record(const ScriptVariable& value, const std::string& error = "") noexcept;
+};
+
+struct ScriptBudget;
+// steps taken from a `ScriptBudget` at once, see `ScriptBudget::tick`
+struct _budgetTaken {
+    const ScriptBudget* budget = nullptr;
+    size_t run = 0;
+    size_t left = 0;
+};
+
+// the labels of one `run_label` and every label they `call`, the frames are reused.
+// `call` runs its label in a nested loop until the thread has `max_nested` of them,
+// deeper labels run in that loop, so only `Interpreter::max_call_depth` limits recursion
+struct _frameStack {
+    static constexpr size_t max_nested = 32;
+
+    std::shared_ptr<const std::map<std::string,ScriptLabel>> labels;
+    _labelCodes codes;
+    std::vector<std::unique_ptr<_scriptFrame>> frames;
+    // frames[0,size) are running
+    size_t size = 0;
+    // depth of the run that started this one
+    size_t base = 0;
+    // a `call` of a deep frame that starts once the statement gave up
+    struct {
+        bool active = false;
+        std::string label;
+        std::vector<ScriptVariable> args;
+    } pending;
+    // set once a `call` hit `Interpreter::max_call_depth`, the error of the label
+    // that made it then goes up to the first frame as it is
+    bool overflow = false;
+    std::string overflow_error;
+    // for `Interpreter::run_async`: `run` gives up after `slice` statements or when a builtin
+    // has to wait (`waiting` is set then) and sets `suspended`, `run` continues after that
+    size_t slice = 0;
+    size_t steps = 0;
+    bool suspended = false;
+    std::function<bool()> waiting;
+    // for `Interpreter::resume`: once the budget is used up `run` gives up at the statement
+    // that ran out and sets `suspended`, `resume` runs that statement again
+    bool preemptible = false;
+
+    // nested loops of `run` on this thread, including those of the stack that started this one
+    size_t nested = 0;
+    // steps of `Interpreter::budget` the frames haven't used yet
+    _budgetTaken budget;
+
+    // the stack the current thread runs, to find the depth of the run that starts a new one
+    inline static thread_local _frameStack* current = nullptr;
+
+    inline size_t depth() const noexcept { return base + size; }
+    inline _scriptFrame& top() noexcept { return *frames[size - 1]; }
+    // the frame that runs with `settings` right now. It's kept in the settings, extensions
+    // are libraries of their own and would see their own copy of a thread local
+    inline static _scriptFrame* frame_of(const ScriptSettings& settings) noexcept {
+        return settings.running.frame;
+    }
+
+    inline _scriptFrame& push(ScriptSettings* settings, bool deep) noexcept;
+    inline void attach(_scriptFrame& frame, ScriptSettings* settings) noexcept;
+    // copies `labels` into the settings of a label it starts, unless they have them already
+    inline void share_labels(ScriptSettings& settings) noexcept;
+    inline void pop() noexcept;
+    // runs the frames until the one at `until` is done and returns its error
+    inline std::string run(size_t until) noexcept;
+    inline std::string resume() noexcept;
+    inline void _start_pending() noexcept;
+    inline void _finish(const std::string& label_name, const std::string& error) noexcept;
+};
+
+// a piece of source that starts with a pre processor line (or the start of the file)
+struct PreProcessChunk {
+    enum Kind { PRELUDE, LABEL, CONST, BAKE, PRAGMA } kind = PRELUDE;
+    size_t begin = 0;
+    size_t end = 0;
+    // newlines in the source before `begin`
+    size_t newlines = 0;
+    // label name for LABEL chunks
+    std::string name;
+
+    // filled while pre processing
+    size_t lines = 0;
+    std::vector<std::string> constants;
+    // the line of a pragma, it runs again on every reload
+    lexed_kittens instruction;
+};
+
+// remembers the last pre processed source to make reloading it cheap
+struct PreProcessCache {
+    std::string source;
+    std::vector<PreProcessChunk> chunks;
+    std::unordered_set<std::string> baked;
+    bool valid = false;
+
+    inline void clear() noexcept {
+        source.clear();
+        chunks.clear();
+        baked.clear();
+        valid = false;
+    }
+};
 
 // preprocesses the file into the interpreter
 inline static std::map<std::string,ScriptLabel> pre_process(const std::string& source, ScriptSettings& settings) noexcept;
+// like pre_process, but reuses everything that didn't change since the last call with
+// the same cache. Expects `settings.labels` to still hold the result of that call
+inline static std::map<std::string,ScriptLabel> pre_process_incremental(std::string source, ScriptSettings& settings, PreProcessCache& cache) noexcept;
+// splits the source at every pre processor line
+inline static std::vector<PreProcessChunk> pre_process_chunks(const std::string& source) noexcept;
 inline static std::vector<ScriptVariable> parse_argumentlist(std::string source, ScriptSettings& settings) noexcept;
 // evaluates an expression and returns the result
 inline static  ScriptVariable evaluate_expression(const std::string& source, ScriptSettings& settings) noexcept;
-inline static void parse_const_preprog(const std::string& source, ScriptSettings& settings) noexcept;
+// the names of the constants it sets are added to `names` if given
+inline static void parse_const_preprog(const std::string& source, ScriptSettings& settings, std::vector<std::string>* names = nullptr) noexcept;
 
 inline static bool is_operator_char(char) noexcept;
+inline static bool is_name(const std::string&) noexcept;
 
 // default lexers, can be accessed and configured by the user 
 struct LexerCollection {
@@ -253,8 +850,10 @@ struct LexerCollection {
         .ignore_backslash_opts()
         .erase_empty();
     
+    // empties the lexers above and makes the p_* functions use them
     void clear() {
         argumentlist = expression = preprocess = KittenLexer();
+        use_kittenlexer();
     }
 
     // modify these to customize how source code get turned into tokens
@@ -262,9 +861,425 @@ struct LexerCollection {
     std::function<lexed_kittens(const std::string&)> p_argumentlist = [&](const std::string& s){ return argumentlist.lex(s); };
     std::function<lexed_kittens(const std::string&)> p_expression = [&](const std::string& s){ return expression.lex(s); };
     std::function<lexed_kittens(const std::string&)> p_preprocess = [&](const std::string& s){ return preprocess.lex(s); };
+
+    // hand-written scanners (carescript-lexer.hpp) giving the same tokens as the
+    // lexers above, but a lot faster. Changes to those don't apply after this
+    void use_scanners() {
+        p_argumentlist = script_lex_argumentlist;
+        p_expression = script_lex_expression;
+        p_preprocess = script_lex_preprocess;
+    }
+    // lexes through `argumentlist`, `expression` and `preprocess` again
+    void use_kittenlexer() {
+        p_argumentlist = [&](const std::string& s){ return argumentlist.lex(s); };
+        p_expression = [&](const std::string& s){ return expression.lex(s); };
+        p_preprocess = [&](const std::string& s){ return preprocess.lex(s); };
+    }
+};
+
+// abstract class for where `echo`, `echoln` and `input` write to
+struct ScriptOutput {
+    virtual void write(const char* data, size_t size) = 0;
+    // forces everything buffered so far out of the sink
+    virtual void flush() {}
+
+    inline void print(const std::string& str) { write(str.data(),str.size()); }
+
+    virtual ~ScriptOutput() {}
+};
+
+// default output, buffers per interpreter and hands whole batches to the
+// file descriptor (stdout by default). Writes that don't fit into the buffer
+// get sent together with it in a single writev call instead of being copied
+class ScriptStdOutput : public ScriptOutput {
+    std::string buffer;
+    size_t capacity;
+    int fd;
+
+    inline void write_through(const char* data, size_t size) noexcept {
+        if(buffer.empty() && size == 0) return;
+        if(fd == 1) std::cout.flush();
+#if defined(__linux__)
+        iovec vec[2] = {{buffer.data(),buffer.size()},{(void*)data,size}};
+        iovec* iov = vec;
+        int iovcnt = size == 0 ? 1 : 2;
+        if(buffer.empty()) { ++iov; --iovcnt; }
+        while(iovcnt > 0) {
+            ssize_t written = ::writev(fd,iov,iovcnt);
+            if(written < 0) {
+                if(errno == EINTR) continue;
+                break;
+            }
+            while(iovcnt > 0 && (size_t)written >= iov->iov_len) {
+                written -= iov->iov_len;
+                ++iov; --iovcnt;
+            }
+            if(iovcnt > 0) {
+                iov->iov_base = (char*)iov->iov_base + written;
+                iov->iov_len -= written;
+            }
+        }
+#else
+        std::FILE* file = fd == 2 ? stderr : stdout;
+        std::fwrite(buffer.data(),1,buffer.size(),file);
+        if(size != 0) std::fwrite(data,1,size,file);
+        std::fflush(file);
+#endif
+        buffer.clear();
+    }
+public:
+    ScriptStdOutput(int fd = 1, size_t capacity = 1 << 14): capacity(capacity), fd(fd) {}
+
+    void write(const char* data, size_t size) override {
+        if(buffer.size() + size <= capacity) buffer.append(data,size);
+        else write_through(data,size);
+    }
+    void flush() override { write_through(nullptr,0); }
+
+    ~ScriptStdOutput() { flush(); }
+};
+
+// how the default operators compute numbers that aren't integers.
+// LONG_DOUBLE keeps the full precision, DOUBLE rounds every result
+// (and number literal) to a double, which is faster on most machines
+enum class ScriptNumberMode { LONG_DOUBLE, DOUBLE };
+
+inline static const char* script_budget_exhausted = "execution budget exhausted";
+inline static const char* script_not_resumable = "no preempted run to resume";
+inline static const char* script_memory_exhausted = "memory limit exceeded";
+
+// bytes held by the variables, constants and return values of an interpreter
+// (including those of running labels), measured with `ScriptValue::memory_usage`.
+// Labels running in parallel (see `parallel_call`) count into it at the same time
+struct ScriptMemory {
+    std::atomic<size_t> current = 0;
+    std::atomic<size_t> peak = 0;
+    // 0 means no limit
+    size_t limit = 0;
+
+    ScriptMemory() {}
+    ScriptMemory(const ScriptMemory& memory): current(memory.current.load()), peak(memory.peak.load()), limit(memory.limit) {}
+    ScriptMemory& operator=(const ScriptMemory& memory) {
+        current = memory.current.load();
+        peak = memory.peak.load();
+        limit = memory.limit;
+        return *this;
+    }
+
+    // false (without changing anything) if the limit would be exceeded
+    inline bool change(size_t old_bytes, size_t new_bytes) noexcept {
+        size_t now = current.load(std::memory_order_relaxed);
+        if(new_bytes <= old_bytes) {
+            while(!current.compare_exchange_weak(now,now - std::min(now,old_bytes - new_bytes),std::memory_order_relaxed));
+            return true;
+        }
+        size_t grown;
+        do {
+            grown = now + (new_bytes - old_bytes);
+            if(limit != 0 && grown > limit) return false;
+        } while(!current.compare_exchange_weak(now,grown,std::memory_order_relaxed));
+        size_t top = peak.load(std::memory_order_relaxed);
+        while(grown > top && !peak.compare_exchange_weak(top,grown,std::memory_order_relaxed));
+        return true;
+    }
+};
+
+// return values of the labels marked with `@pragma memoize <label> [size]`, keyed
+// by the arguments they got. `call` doesn't run such a label again for arguments
+// it has seen, so only mark labels that depend on nothing but their arguments.
+// Each label keeps the results of its `size` (default 1024) most recently used
+// argument lists. Pre processing (also by `eval`) and loading a program forget all of them.
+// Safe to use from several threads
+struct ScriptMemo {
+    using _internalEntry = std::pair<std::vector<ScriptVariable>,ScriptVariable>;
+    struct _internalHash {
+        size_t operator()(const std::vector<ScriptVariable>* args) const noexcept {
+            size_t ret = args->size();
+            for(auto& i : *args) ret = script_hash_combine(ret,i.hash());
+            return ret;
+        }
+    };
+    struct _internalEqual {
+        bool operator()(const std::vector<ScriptVariable>* a, const std::vector<ScriptVariable>* b) const noexcept {
+            if(a->size() != b->size()) return false;
+            for(size_t i = 0; i < a->size(); ++i) {
+                if(!((*a)[i] == (*b)[i])) return false;
+            }
+            return true;
+        }
+    };
+    struct _internalLabel {
+        size_t size = 0;
+        // most recently used first, `index` points at the arguments in here
+        std::list<_internalEntry> entries;
+        std::unordered_map<const std::vector<ScriptVariable>*,std::list<_internalEntry>::iterator,_internalHash,_internalEqual> index;
+    };
+    std::unordered_map<std::string,_internalLabel> labels;
+    mutable std::mutex mutex;
+    // `labels` isn't empty, so `call` of a label that isn't memoized doesn't lock `mutex`
+    std::atomic<bool> any = false;
+
+    // copies memoize the same labels, but start without results
+    ScriptMemo() {}
+    ScriptMemo(const ScriptMemo& memo) { *this = memo; }
+    ScriptMemo& operator=(const ScriptMemo& memo) {
+        if(this == &memo) return *this;
+        std::scoped_lock lock(mutex,memo.mutex);
+        labels.clear();
+        for(auto& [name,label] : memo.labels) labels[name].size = label.size;
+        any.store(!labels.empty(),std::memory_order_relaxed);
+        return *this;
+    }
+
+    // starts memoizing `label`, or changes how many results it keeps
+    inline void memoize(const std::string& label, size_t size = 1024) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        _internalLabel& memo = labels[label];
+        memo.size = size;
+        any.store(true,std::memory_order_relaxed);
+        while(memo.entries.size() > size) _drop_last(memo);
+    }
+    inline bool memoized(const std::string& label) const noexcept {
+        if(!any.load(std::memory_order_relaxed)) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        return labels.count(label) != 0;
+    }
+
+    // true and the stored result in `ret` if `label` already ran with `args`
+    inline bool lookup(const std::string& label, const std::vector<ScriptVariable>& args, ScriptVariable& ret) noexcept {
+        if(!any.load(std::memory_order_relaxed)) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto memo = labels.find(label);
+        if(memo == labels.end()) return false;
+        auto found = memo->second.index.find(&args);
+        if(found == memo->second.index.end()) return false;
+        memo->second.entries.splice(memo->second.entries.begin(),memo->second.entries,found->second);
+        ret = found->second->second;
+        return true;
+    }
+    inline void store(const std::string& label, const std::vector<ScriptVariable>& args, const ScriptVariable& result) noexcept {
+        if(!any.load(std::memory_order_relaxed)) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto memo = labels.find(label);
+        if(memo == labels.end() || memo->second.size == 0) return;
+        _internalLabel& m = memo->second;
+        auto found = m.index.find(&args);
+        if(found != m.index.end()) {
+            found->second->second = result;
+            return;
+        }
+        m.entries.emplace_front(args,result);
+        m.index.emplace(&m.entries.front().first,m.entries.begin());
+        if(m.entries.size() > m.size) _drop_last(m);
+    }
+
+    // forgets the results of `label`, it stays memoized
+    inline void clear(const std::string& label) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto memo = labels.find(label);
+        if(memo == labels.end()) return;
+        memo->second.index.clear();
+        memo->second.entries.clear();
+    }
+    // forgets all results, the labels stay memoized
+    inline void clear() noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto& i : labels) {
+            i.second.index.clear();
+            i.second.entries.clear();
+        }
+    }
+    // forgets the results and which labels are memoized
+    inline void reset() noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        labels.clear();
+        any.store(false,std::memory_order_relaxed);
+    }
+
+    inline static void _drop_last(_internalLabel& memo) noexcept {
+        memo.index.erase(&memo.entries.back().first);
+        memo.entries.pop_back();
+    }
+};
+
+// the pre processed labels of the `capacity` most recently evaluated snippets, keyed by
+// the hash of their source and the table version of the interpreter, so `eval` of a
+// snippet it has seen skips lexing and pre processing. Snippets with @const, @bake
+// or @pragma lines change the interpreter while they are pre processed and never get cached.
+// Safe to use from several threads
+struct ScriptEvalCache {
+    using _internalLabels = std::shared_ptr<const std::map<std::string,ScriptLabel>>;
+    struct _internalEntry {
+        size_t key = 0;
+        size_t version = 0;
+        std::string source;
+        _internalLabels labels;
+    };
+    // most recently used first, `index` points at the entry of every key
+    std::list<_internalEntry> entries;
+    std::unordered_map<size_t,std::list<_internalEntry>::iterator> index;
+    size_t capacity = 64;
+    size_t hits = 0;
+    size_t misses = 0;
+    mutable std::mutex mutex;
+
+    // copies start empty
+    ScriptEvalCache() {}
+    ScriptEvalCache(const ScriptEvalCache& cache): capacity(cache.capacity) {}
+    ScriptEvalCache& operator=(const ScriptEvalCache& cache) {
+        if(this == &cache) return *this;
+        clear();
+        capacity = cache.capacity;
+        return *this;
+    }
+
+    inline static size_t _key(const std::string& source, size_t version) noexcept {
+        return script_hash_combine(std::hash<std::string>{}(source),version);
+    }
+
+    // the labels of `source`, nullptr if it isn't cached (counted as a miss)
+    inline _internalLabels lookup(const std::string& source, size_t version) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(_key(source,version));
+        if(found == index.end() || found->second->version != version || found->second->source != source) {
+            ++misses;
+            return nullptr;
+        }
+        entries.splice(entries.begin(),entries,found->second);
+        ++hits;
+        return found->second->labels;
+    }
+    inline void store(const std::string& source, size_t version, _internalLabels labels) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(capacity == 0) return;
+        const size_t key = _key(source,version);
+        auto found = index.find(key);
+        if(found != index.end()) {
+            entries.erase(found->second);
+            index.erase(found);
+        }
+        entries.push_front({key,version,source,std::move(labels)});
+        index[key] = entries.begin();
+        while(entries.size() > capacity) {
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+
+    inline size_t size() const noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+    // forgets the snippets, the counters stay
+    inline void clear() noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        index.clear();
+        entries.clear();
+    }
+};
+
+// limits how much a single `run`, `eval` or `resume` may do. Every statement
+// and every operator counts as a step (once, even if it runs again after a `call`), 0 means no limit.
+// Labels running in parallel (see `parallel_call`) share the budget. Every run of labels
+// takes `batch` steps at once, so the others may run out up to that many steps early
+struct ScriptBudget {
+    static constexpr size_t batch = 256;
+
+    size_t max_steps = 0;
+    std::chrono::steady_clock::duration timeout = std::chrono::steady_clock::duration::zero();
+
+    // steps taken by the threads so far
+    std::atomic<size_t> steps = 0;
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<bool> exhausted = false;
+    // new for every `start`, steps taken before don't count then
+    size_t run = 0;
+
+    ScriptBudget() {}
+    ScriptBudget(const ScriptBudget& budget) { *this = budget; }
+    ScriptBudget& operator=(const ScriptBudget& budget) {
+        max_steps = budget.max_steps;
+        timeout = budget.timeout;
+        steps = budget.steps.load();
+        deadline = budget.deadline;
+        exhausted = budget.exhausted.load();
+        run = budget.run;
+        return *this;
+    }
+
+    inline bool limited() const noexcept { return max_steps != 0 || timeout != timeout.zero(); }
+
+    inline void start() noexcept {
+        steps = 0;
+        exhausted = false;
+        ++run;
+        if(timeout != timeout.zero()) deadline = std::chrono::steady_clock::now() + timeout;
+    }
+    // counts a step, returns false once the budget is used up. With `taken` the
+    // steps are taken `batch` at a time. The clock is only read every `batch` steps
+    inline bool tick(_budgetTaken* taken = nullptr) noexcept {
+        if(!limited()) return true;
+        if(exhausted.load(std::memory_order_relaxed)) return false;
+        if(taken != nullptr && taken->left != 0 && taken->budget == this && taken->run == run) {
+            --taken->left;
+            return true;
+        }
+        const size_t want = taken == nullptr ? 1 : batch;
+        const size_t first = steps.fetch_add(want,std::memory_order_relaxed);
+        size_t count = want;
+        if(max_steps != 0) count = first >= max_steps ? 0 : std::min(want,max_steps - first);
+        if(count == 0 || (timeout != timeout.zero() && first / batch != (first + want) / batch && std::chrono::steady_clock::now() >= deadline)) {
+            exhausted.store(true,std::memory_order_relaxed);
+            return false;
+        }
+        if(taken != nullptr) *taken = {this,run,count - 1};
+        return true;
+    }
+};
+
+// lines given to a running script with `Interpreter::feed_input`,
+// shared between threads
+struct ScriptInputQueue {
+    std::mutex mutex;
+    std::deque<std::string> lines;
+
+    inline void push(std::string line) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        lines.push_back(std::move(line));
+    }
+    inline bool pop(std::string& line) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(lines.empty()) return false;
+        line = std::move(lines.front());
+        lines.pop_front();
+        return true;
+    }
+    inline bool empty() noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        return lines.empty();
+    }
+};
+
+// captures all output into a string, useful for testing
+struct ScriptStringOutput : public ScriptOutput {
+    std::string data;
+
+    void write(const char* str, size_t size) override { data.append(str,size); }
+
+    inline const std::string& string() const noexcept { return data; }
+    inline void clear() noexcept { data.clear(); }
+};
+
+// drops all output, what `set_output(nullptr)` writes to
+struct ScriptNullOutput : public ScriptOutput {
+    void write(const char*, size_t) override {}
 };
 
 class Interpreter;
+class ScriptTask;
+class ScriptProgram;
+class ScriptExpression;
+struct ScriptBatchResult;
 // storage class to temporarily store states of the interpreter
 struct InterpreterState {
     std::map<std::string,ScriptBuiltin> script_builtins;
@@ -378,11 +1393,51 @@ public:
 
 struct ExtensionData;
 
+// a label to run with `Interpreter::run_many`
+struct ScriptJob {
+    std::string label;
+    std::vector<ScriptVariable> args;
+};
+// what a job of `Interpreter::run_many` returned, `error` is empty if it ran without one
+struct ScriptJobResult {
+    ScriptVariable value = script_null;
+    std::string error;
+};
+
+// where the `parallel_call` label running on a thread writes to
+struct _branchOutput {
+    const Interpreter* owner = nullptr;
+    std::shared_ptr<ScriptOutput> sink;
+};
+
 // wrapper and storage class for a simpler API usage
 class Interpreter {
     std::vector<ExtensionData> extensions;
     std::map<int,InterpreterState> states;
     std::function<void(Interpreter&)> on_error_f;
+    std::shared_ptr<ScriptOutput> output_sink = std::make_shared<ScriptStdOutput>();
+    PreProcessCache preprocess_cache;
+    // see `shared_labels`
+    std::shared_ptr<const std::map<std::string,ScriptLabel>> labels_copy;
+    std::shared_ptr<ScriptInputQueue> input_queue = std::make_shared<ScriptInputQueue>();
+    // the frames of the last `run` the budget stopped, for `resume`. Copies don't get them
+    struct _internalPreempted {
+        std::unique_ptr<_frameStack> stack;
+        _internalPreempted() {}
+        _internalPreempted(const _internalPreempted&) {}
+        _internalPreempted& operator=(const _internalPreempted&) { stack = nullptr; return *this; }
+    };
+    // see `table_version`
+    size_t tables_version = 0;
+    // see `thread_pool`, started on first use. Copies start their own
+    struct _internalPool {
+        std::unique_ptr<ScriptThreadPool> pool;
+        std::mutex mutex;
+        _internalPool() {}
+        _internalPool(const _internalPool&) {}
+        _internalPool& operator=(const _internalPool&) { return *this; }
+    } branch_pool;
+    inline static thread_local _branchOutput branch_output;
 
     inline void error_check() {
         if(settings.error_msg != "" && on_error_f) on_error_f(*this);
@@ -392,11 +1447,43 @@ public:
     std::map<std::string,std::vector<ScriptOperator>> script_operators = default_script_operators;
     std::vector<ScriptTypeCheck> script_typechecks = default_script_typechecks;
     std::unordered_map<std::string,std::string> script_macros = default_script_macros;
-    std::unordered_map<std::string,ScriptPreProcess> script_preprocesses;
+    std::unordered_map<std::string,ScriptPreProcess> script_preprocesses = default_script_preprocesses;
     std::unordered_map<std::string,ScriptRawBuiltin> script_rawbuiltins;
+    std::unordered_map<std::string,ScriptNativeLabel> native_labels;
     
     LexerCollection lexer;
+    // above `settings`, which gives its bytes back to `memory` when it's destroyed
+    ScriptMemory memory;
+    ScriptMemo memo;
     ScriptSettings settings = ScriptSettings(*this);
+    // below `memory` too, the labels it holds give their bytes back when it's destroyed
+    _internalPreempted preempted_run;
+    // lex the labels of big sources on multiple threads,
+    // turn off if `lexer.p_preprocess` can't be called concurrently
+    bool parallel_pre_process = true;
+    // pragmas that only use their own line, `reload` runs them again every time (after
+    // resetting `memo`) and keeps reusing unchanged labels. Sources using other pragmas
+    // are always fully pre processed
+    std::unordered_set<std::string> local_pragmas = {"memoize"};
+    // `input` reads the lines given to `feed_input` instead of std::cin
+    // and waits (or suspends, see carescript-async.hpp) until one is there
+    bool queued_input = false;
+    ScriptNumberMode number_mode = ScriptNumberMode::LONG_DOUBLE;
+    // `to_string` writes the shortest text that parses back to the number
+    // instead of six decimals like `std::to_string`
+    bool shortest_to_string = false;
+    // threads `parallel_call` and `run_many` run labels on (including the calling one),
+    // has to be set before its first use. `lexer.p_expression` and
+    // `lexer.p_argumentlist` have to be callable concurrently for more than one
+    size_t parallel_threads = std::thread::hardware_concurrency();
+    // labels running at the same time in one run, counting `call`s and their callers.
+    // A `call` beyond it fails
+    size_t max_call_depth = 10000;
+    ScriptBudget budget;
+    ScriptOperatorCache operator_cache;
+    ScriptEvalCache eval_cache;
+    // state of extensions, see `slot<T>()`
+    ScriptSlots slots;
     
     inline void save(int id) noexcept {
         states[id].save(*this);
@@ -404,6 +1491,7 @@ public:
 
     inline void load(int id) noexcept {
         states[id].load(*this);
+        ++tables_version;
     }
 
     inline void clear() {
@@ -413,10 +1501,21 @@ public:
         script_macros.clear();
         script_preprocesses.clear();
         script_rawbuiltins.clear();
+        native_labels.clear();
         lexer.clear();
         settings.clear();
+        preprocess_cache.clear();
+        operator_cache.clear();
+        memo.reset();
+        slots.clear();
+        ++tables_version;
     }
 
+    // changes whenever builtins, operators, typechecks, macros, raw builtins or pre
+    // processes get added through the interpreter or an extension, and when the tables
+    // get cleared or loaded. Call `eval_cache.clear()` after changing them (or the lexers) directly
+    inline size_t table_version() const noexcept { return tables_version; }
+
     inline operator bool() const noexcept {
         return settings.error_msg == "";
     }
@@ -424,19 +1523,53 @@ public:
         return settings;
     }
 
+    // `settings.labels` as the labels of a run get them, copied once after they changed.
+    // Call `labels_changed()` after changing `settings.labels` directly
+    inline std::shared_ptr<const std::map<std::string,ScriptLabel>> shared_labels() noexcept {
+        if(labels_copy == nullptr) labels_copy = std::make_shared<const std::map<std::string,ScriptLabel>>(settings.labels);
+        return labels_copy;
+    }
+    // `labels` if they are the same as `settings.labels` already
+    inline void labels_changed(std::shared_ptr<const std::map<std::string,ScriptLabel>> labels = nullptr) noexcept {
+        labels_copy = std::move(labels);
+    }
+
+    // also remembers the source for the next `reload`
     inline InterpreterError pre_process(std::string source) noexcept {
         settings.error_msg = "";
-        settings.labels = ::carescript::pre_process(source,settings);
+        preprocess_cache.clear();
+        memo.reset();
+        labels_changed();
+        settings.labels = pre_process_incremental(std::move(source),settings,preprocess_cache);
+        error_check();
+        return *this;
+    }
+
+    // runs a program packed by `ScriptProgram` from now on, see carescript-program.hpp
+    inline InterpreterError load(const ScriptProgram& program) noexcept;
+
+    // pre processes a new version of the last pre processed or reloaded source. Only
+    // labels whose text changed get lexed again, `@const` blocks are only evaluated
+    // again if one of them changed and extensions are never baked twice.
+    // Sources using pragmas other than `local_pragmas` are always fully pre processed
+    inline InterpreterError reload(std::string source) noexcept {
+        settings.error_msg = "";
+        memo.reset();
+        labels_changed();
+        settings.labels = pre_process_incremental(std::move(source),settings,preprocess_cache);
         error_check();
         return *this;
     }
 
     inline InterpreterError run() noexcept {
-        settings.return_value = script_null;
+        settings.set_return_value(script_null);
+        settings.error_msg = "";
         settings.line = 1;
         settings.exit = false;
-        settings.error_msg = run_label("main",settings.labels,settings,"",{});
+        budget.start();
+        settings.error_msg = run_label_preemptible("main",settings,{},preempted_run.stack);
         settings.exit = false;
+        output_sink->flush();
         error_check();
         return is_null(settings.return_value) ? *this : InterpreterError(*this,settings.return_value);
     }
@@ -447,28 +1580,119 @@ public:
         return run(label,args);
     }
     inline InterpreterError run(std::string label, std::vector<ScriptVariable> args) noexcept {
-        settings.return_value = script_null;
+        settings.set_return_value(script_null);
+        settings.error_msg = "";
         settings.line = 1;
         settings.exit = false;
-        settings.error_msg = run_label(label,settings.labels,settings,"",args);
+        budget.start();
+        settings.error_msg = run_label_preemptible(label,settings,args,preempted_run.stack);
         settings.exit = false;
+        output_sink->flush();
         error_check();
         return is_null(settings.return_value) ? *this : InterpreterError(*this,settings.return_value);
     }
 
+    // runs every job on `thread_pool()` and returns their results in the same order.
+    // Each job starts with its own variables (the constants are shared), like a label
+    // run with `call`. The jobs share the budget, their output is written in job order.
+    // Errors are returned per job and don't go through `on_error`
+    inline std::vector<ScriptJobResult> run_many(const std::vector<ScriptJob>& jobs) noexcept {
+        std::vector<ScriptJobResult> results(jobs.size());
+        std::vector<std::shared_ptr<ScriptStringOutput>> outputs(jobs.size());
+        budget.start();
+        ScriptThreadPool& pool = thread_pool();
+        // one copy for all jobs, their `settings.labels` stay empty (see `script_labels`)
+        const auto labels = shared_labels();
+        ++operator_cache.shared;
+        pool.parallel_for(jobs.size(),[&](size_t i) {
+            outputs[i] = std::make_shared<ScriptStringOutput>();
+            auto label = labels->find(jobs[i].label);
+            if(label == labels->end()) {
+                results[i].error = "no such label " + jobs[i].label;
+                return;
+            }
+            if(label->second.arglist.size() != jobs[i].args.size()) {
+                results[i].error = std::string(label->second.arglist.size() > jobs[i].args.size() ? "too few" : "too many") + " arguments for " + jobs[i].label;
+                return;
+            }
+            auto previous = redirect_output(outputs[i]);
+            ScriptSettings tset(*this);
+            tset.constants = settings.constants;
+            results[i].error = _run_label(jobs[i].label,labels,tset,"",jobs[i].args);
+            results[i].value = std::move(tset.return_value);
+            redirect_output(std::move(previous));
+        });
+        --operator_cache.shared;
+
+        for(auto& i : outputs) output_sink->print(i->string());
+        output_sink->flush();
+        return results;
+    }
+
+    // limits the following runs, see `ScriptBudget`
+    inline Interpreter& set_budget(size_t max_steps, std::chrono::steady_clock::duration timeout = std::chrono::steady_clock::duration::zero()) noexcept {
+        budget.max_steps = max_steps;
+        budget.timeout = timeout;
+        return *this;
+    }
+    // true if the last run stopped because of the budget
+    inline bool preempted() const noexcept { return budget.exhausted; }
+
+    // storing values beyond `bytes` fails with a script error, 0 removes the limit
+    inline Interpreter& set_memory_limit(size_t bytes) noexcept {
+        memory.limit = bytes;
+        return *this;
+    }
+    inline size_t memory_usage() const noexcept { return memory.current; }
+    inline size_t peak_memory_usage() const noexcept { return memory.peak; }
+
+    // continues the last `run` that got preempted, with a fresh budget. The statement that
+    // was interrupted runs again, labels and operators it ran already don't (the frames of
+    // `run` are kept for that), so a budget too small for its first operator never gets past it.
+    // Fails if there is nothing to continue
+    inline InterpreterError resume() noexcept {
+        settings.error_msg = "";
+        settings.exit = false;
+        budget.start();
+        settings.error_msg = run_preempted(settings,preempted_run.stack);
+        settings.exit = false;
+        output_sink->flush();
+        error_check();
+        return is_null(settings.return_value) ? *this : InterpreterError(*this,settings.return_value);
+    }
+
+    // runs a label as a coroutine, see carescript-async.hpp. Nothing else may use
+    // the interpreter until the task is done. Every `slice` statements it suspends
+    template<typename... Targs>
+    inline ScriptTask run_async(std::string label, Targs ...targs);
+    inline ScriptTask run_async(std::string label, std::vector<ScriptVariable> args, size_t slice = 256) noexcept;
+
+    // runs `source` like the main label of a script, snippets it has seen
+    // before come pre processed from `eval_cache`
     inline InterpreterError eval(std::string source) noexcept {
-        settings.return_value = script_null;
+        settings.set_return_value(script_null);
+        budget.start();
         settings.error_msg = run_script(source,settings);
         settings.exit = false;
+        output_sink->flush();
         error_check();
         return is_null(settings.return_value) ? *this : InterpreterError(*this,settings.return_value);
     }
     inline InterpreterError expression(std::string source) {
+        budget.start();
         auto ret = evaluate_expression(source,settings);
+        output_sink->flush();
         error_check();
         return is_null(ret) ? *this : InterpreterError(*this,ret);
     }
 
+    // compiles `source` once for `evaluate_batch`, the `$name`s of `parameters` read
+    // the row being evaluated. See carescript-expression.hpp
+    inline ScriptExpression compile_expression(const std::string& source, std::vector<std::string> parameters = {}) noexcept;
+    // evaluates `expression` for every row of `columns`, one column per parameter.
+    // Parameters are bound like variables and count against the memory limit
+    inline ScriptBatchResult evaluate_batch(const ScriptExpression& expression, const std::vector<std::vector<ScriptVariable>>& columns) noexcept;
+
     inline int to_local_line(const int& line) const noexcept { return line - settings.labels.at(settings.label.top()).line; }
     inline int to_global_line(const int& line) const noexcept { return line + settings.labels.at(settings.label.top()).line; }
 
@@ -478,30 +1702,82 @@ public:
 
     inline std::string error() const noexcept { return settings.error_msg; }
 
+    // the sink `echo`, `echoln` and `input` write to, buffered until
+    // the end of `run`, `eval`, `expression` or an explicit `flush()`.
+    // Labels started by `parallel_call` write into a sink of their own
+    inline ScriptOutput& output() noexcept {
+        return branch_output.owner == this ? *branch_output.sink : *output_sink;
+    }
+    inline std::shared_ptr<ScriptOutput> get_output() const noexcept {
+        return branch_output.owner == this ? branch_output.sink : output_sink;
+    }
+    // makes `output()` return `sink` on this thread until the returned value
+    // is given back, see `parallel_call`
+    inline _branchOutput redirect_output(std::shared_ptr<ScriptOutput> sink) noexcept {
+        return std::exchange(branch_output,_branchOutput{this,std::move(sink)});
+    }
+    inline void redirect_output(_branchOutput previous) noexcept {
+        branch_output = std::move(previous);
+    }
+    // a null sink discards the output
+    inline Interpreter& set_output(std::shared_ptr<ScriptOutput> sink) noexcept {
+        output_sink->flush();
+        output_sink = sink ? std::move(sink) : std::make_shared<ScriptNullOutput>();
+        return *this;
+    }
+    // redirects all output into a string and returns it
+    inline std::shared_ptr<ScriptStringOutput> capture_output() noexcept {
+        auto sink = std::make_shared<ScriptStringOutput>();
+        set_output(sink);
+        return sink;
+    }
+    inline void flush() noexcept { output_sink->flush(); }
+
+    // the pool `parallel_call` and `run_many` run labels on
+    inline ScriptThreadPool& thread_pool() noexcept {
+        std::lock_guard<std::mutex> lock(branch_pool.mutex);
+        if(branch_pool.pool == nullptr) branch_pool.pool = std::make_unique<ScriptThreadPool>(std::max<size_t>(parallel_threads,1));
+        return *branch_pool.pool;
+    }
+
+    // queues a line for `input`, can be called from any thread
+    inline Interpreter& feed_input(std::string line) noexcept {
+        input_queue->push(std::move(line));
+        return *this;
+    }
+    inline std::shared_ptr<ScriptInputQueue> get_input() const noexcept { return input_queue; }
+
     inline Interpreter& add_builtin(const std::string& name, const ScriptBuiltin& builtin) noexcept {
         script_builtins[name] = builtin;
+        ++tables_version;
         return *this;
     }
     inline Interpreter& add_operator(const std::string& name, const ScriptOperator& _operator) {
         if(lexer.p_expression(name).size() != 1) 
             throw "Carescript: Operator name must be 1 token";
         script_operators[name].push_back(_operator);
+        operator_cache.build(script_operators[name]);
+        ++tables_version;
         return *this;
     }
     inline Interpreter& add_typecheck(const ScriptTypeCheck& typecheck) noexcept {
         script_typechecks.push_back(typecheck);
+        ++tables_version;
         return *this;
     }
     inline Interpreter& add_macro(const std::string& macro, const std::string& replacement) noexcept {
         script_macros[macro] = replacement;
+        ++tables_version;
         return *this;
     }
     inline Interpreter& add_rawbuiltin(const std::string& name, const ScriptRawBuiltin& rawbuiltin) noexcept {
         script_rawbuiltins[name] = rawbuiltin;
+        ++tables_version;
         return *this;
     }
     inline Interpreter& add_preprocess(const std::string& name, const ScriptPreProcess& process) noexcept {
         script_preprocesses[name] = process;
+        ++tables_version;
         return *this;
     }
 
@@ -566,12 +1842,22 @@ public:
     inline bool has_extension(const std::string& id) const noexcept {
         return get_extension(id) != nullptr;
     }
+
+    // the value of type `T` kept for extensions, created on first access.
+    // Calling it in `Extension::poke_interpreter` resolves its index at bake time
+    template<typename T>
+    inline T& slot() noexcept { return slots.get<T>(); }
     
     friend inline bool bake_extension(ExtensionData ext, ScriptSettings& settings) noexcept;
 
     ~Interpreter();
 };
 
+template<typename T>
+inline T& ScriptSettings::slot() noexcept {
+    return interpreter.slots.get<T>();
+}
+
 inline InterpreterError& InterpreterError::on_error(const std::function<void(Interpreter&)>& fun) noexcept {
     if(!interpreter) fun(interpreter);
     return *this;
@@ -648,6 +1934,9 @@ extern "C" { \
             [&]()->t*{ __VA_ARGS__ }() \
         ); \
     } \
+    void destroy_extension(carescript::Extension* ext) { \
+        delete ext; \
+    } \
 }
 #define CARESCRIPT_EXTENSION_GETEXT_INLINE(...) \
 extern "C" { \
@@ -657,6 +1946,9 @@ extern "C" { \
             [&]()->t*{ __VA_ARGS__ }() \
         ); \
     } \
+    inline static void destroy_extension(carescript::Extension* ext) { \
+        delete ext; \
+    } \
 }
 
 using BuiltinList = std::unordered_map<std::string,ScriptBuiltin>;
@@ -665,6 +1957,7 @@ using MacroList = std::unordered_map<std::string,std::string>;
 using TypeList = std::vector<ScriptTypeCheck>;
 using RawBuiltinList = std::unordered_map<std::string,ScriptRawBuiltin>;
 using PreProcList = std::unordered_map<std::string,ScriptPreProcess>;
+using NativeLabelList = std::unordered_map<std::string,ScriptNativeLabel>;
 
 // abstract class to provide an interface for extensions
 class Extension {
@@ -678,6 +1971,7 @@ public:
     virtual TypeList get_types() { return {}; }
     virtual RawBuiltinList get_rawbuiltins() { return {}; }
     virtual PreProcList get_preprocesses() { return {}; }
+    virtual NativeLabelList get_native_labels() { return {}; }
 
     virtual void poke_interpreter(Interpreter&) { return; }
 
@@ -685,12 +1979,17 @@ public:
     inline bool orphan() const noexcept { return interp_link == nullptr; }
     inline Extension& self() noexcept { return *this; }
 
+    virtual ~Extension() {}
+
     friend inline bool bake_extension(ExtensionData ext, ScriptSettings& settings) noexcept;
 };
 
 struct ExtensionData {
     size_t hash = 0;
     Extension* extension = nullptr;
+    // deletes `extension` once no interpreter uses it anymore. Extensions from a
+    // library are destroyed by that library, which stays loaded until then
+    std::shared_ptr<Extension> owner;
 
     template<typename T> requires std::is_base_of_v<Extension,T>
     ExtensionData(T* ext) {
@@ -718,11 +2017,84 @@ inline Extension* Interpreter::get_extension(const size_t& type_id) const noexce
     return nullptr;
 }
 
-inline Interpreter::~Interpreter() {
-    for(auto& i : extensions) {
-        delete i.extension; // TODO: frees not enough bytes
-        i.extension = nullptr;
+inline ScriptSettings::~ScriptSettings() {
+    interpreter.memory.change(accounted.bytes,0);
+}
+
+inline void ScriptSettings::clear() noexcept {
+    account(accounted.bytes,0);
+    line = 0;
+    exit = false;
+    should_run = std::stack<bool>();
+    variables.clear();
+    constants.clear();
+    labels.clear();
+    labels_of = nullptr;
+    parent_path = "";
+    ignore_endifs = 0;
+    return_value = script_null;
+    error_msg = "";
+    raw_error = false;
+    label = std::stack<std::string>();
+    storage.clear();
+    await = nullptr;
+    resumed = false;
+    // the interpreter's copy of `labels` is out of date now
+    if(this == &interpreter.settings) interpreter.labels_changed();
+}
+
+inline bool ScriptSettings::account(size_t old_bytes, size_t new_bytes) noexcept {
+    if(!interpreter.memory.change(old_bytes,new_bytes)) {
+        error_msg = std::string(script_memory_exhausted) + " (limit: " + std::to_string(interpreter.memory.limit) + " bytes)";
+        return false;
     }
+    accounted.bytes += new_bytes;
+    accounted.bytes -= std::min(accounted.bytes,old_bytes);
+    return true;
+}
+
+inline bool ScriptSettings::set_variable(const std::string& name, const ScriptVariable& value) noexcept {
+    auto found = variables.find(name);
+    const size_t old_bytes = found == variables.end() ? 0 : found->second.memory_usage() + name.size();
+    if(!account(old_bytes,value.memory_usage() + name.size())) return false;
+    if(found == variables.end()) variables.emplace(name,value);
+    else found->second = value;
+    return true;
+}
+
+inline bool ScriptSettings::set_constant(const std::string& name, const ScriptVariable& value) noexcept {
+    auto found = constants.find(name);
+    const size_t old_bytes = found == constants.end() ? 0 : found->second.memory_usage() + name.size();
+    if(!account(old_bytes,value.memory_usage() + name.size())) return false;
+    if(found == constants.end()) constants.emplace(name,value);
+    else found->second = value;
+    return true;
+}
+
+inline void ScriptSettings::erase_variable(const std::string& name) noexcept {
+    auto found = variables.find(name);
+    if(found == variables.end()) return;
+    account(found->second.memory_usage() + name.size(),0);
+    variables.erase(found);
+}
+
+inline void ScriptSettings::erase_constant(const std::string& name) noexcept {
+    auto found = constants.find(name);
+    if(found == constants.end()) return;
+    account(found->second.memory_usage() + name.size(),0);
+    constants.erase(found);
+}
+
+inline bool ScriptSettings::set_return_value(const ScriptVariable& value) noexcept {
+    if(!account(return_value.memory_usage(),value.memory_usage())) return false;
+    return_value = value;
+    return true;
+}
+
+// `extensions` is the first member, so every value, builtin and label is gone
+// before the extensions (and the libraries they come from) are released
+inline Interpreter::~Interpreter() {
+    output_sink->flush();
 }
 
 inline InterpreterError Interpreter::bake(ExtensionData ext) noexcept {
@@ -732,12 +2104,34 @@ inline InterpreterError Interpreter::bake(ExtensionData ext) noexcept {
 }
 
 using get_extension_fun = ExtensionData(*)();
+using destroy_extension_fun = void(*)(Extension*);
+
+// extensions linked into the program, by their `id()`. `bake` looks here before
+// it tries to load a library, see CARESCRIPT_EXTENSION_STATIC
+inline std::unordered_map<std::string,get_extension_fun>& static_extensions() noexcept {
+    static std::unordered_map<std::string,get_extension_fun> extensions;
+    return extensions;
+}
+
+struct StaticExtensionRegistrar {
+    StaticExtensionRegistrar(const std::string& id, get_extension_fun create) noexcept {
+        static_extensions()[id] = create;
+    }
+};
+
+// registers a default constructible extension type at startup, so
+// `bake("<its id>")` and `@bake["<its id>"]` create it without any file access
+#define CARESCRIPT_EXTENSION_STATIC(type) \
+    static carescript::StaticExtensionRegistrar _cc_join(_carescript_static_extension_,__LINE__)( \
+        type().id(), \
+        []()->carescript::ExtensionData { return carescript::ExtensionData::make<type>(new type()); } \
+    );
 
 // external overloads for the ScriptVariable constructor
 
 template<typename Tp> requires std::is_arithmetic_v<Tp>
 inline static void from(carescript::ScriptVariable& var, const Tp& integral) noexcept {
-    var = new carescript::ScriptNumberValue(integral);
+    var = carescript::script_number(integral);
 }
 
 inline static void from(carescript::ScriptVariable& var, const std::string& string) noexcept{
@@ -0,0 +1,564 @@
+#ifndef CARESCRIPT_EXPRESSION_HPP
+#define CARESCRIPT_EXPRESSION_HPP
+
+#include "carescript-parsing.hpp"
+
+#include <cmath>
+
+namespace carescript {
+
+// Expressions that are parsed once and then evaluated for many rows of operands.
+// `Interpreter::compile_expression` turns an expression into postfix steps, where
+// the source says `$name` for one of its parameters the step reads the column of
+// that parameter. `Interpreter::evaluate_batch` runs the steps once per row, or one
+// column at a time if all operands are numbers and all operators are the default
+// number operators. Results and errors are those `evaluate_expression` gives with
+// the parameters set as variables.
+//
+// Expressions calling builtins, with literals of extension types (they may read
+// variables) or whose parse depends on the operands (an operator with overloads of
+// different priorities) aren't compiled, they get evaluated the usual way for every row. Compiled steps don't count against the
+// budget, without calls they can't loop.
+
+// the default operators that have a column version
+enum class _numberKernel : unsigned char {
+    NONE,
+    LOOKUP,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    POW,
+    IS,
+    ISNT,
+    AND,
+    OR,
+    MORE,
+    LESS,
+    NEG,
+    NOT,
+};
+
+// which default operator `run` is
+inline static _numberKernel _number_kernel_of(decltype(ScriptOperator::run) run, int type) noexcept {
+    struct _internalEntry {
+        decltype(ScriptOperator::run) run;
+        int type;
+        _numberKernel kernel;
+    };
+    static const std::vector<_internalEntry> entries = []() {
+        const std::tuple<const char*,int,_numberKernel> defaults[] = {
+            {"$",ScriptOperator::UNARY,_numberKernel::LOOKUP},
+            {"+",ScriptOperator::BINARY,_numberKernel::ADD},
+            {"-",ScriptOperator::BINARY,_numberKernel::SUB},
+            {"*",ScriptOperator::BINARY,_numberKernel::MUL},
+            {"/",ScriptOperator::BINARY,_numberKernel::DIV},
+            {"^",ScriptOperator::BINARY,_numberKernel::POW},
+            {"is",ScriptOperator::BINARY,_numberKernel::IS},
+            {"isnt",ScriptOperator::BINARY,_numberKernel::ISNT},
+            {"and",ScriptOperator::BINARY,_numberKernel::AND},
+            {"or",ScriptOperator::BINARY,_numberKernel::OR},
+            {"more",ScriptOperator::BINARY,_numberKernel::MORE},
+            {"less",ScriptOperator::BINARY,_numberKernel::LESS},
+            {"-",ScriptOperator::UNARY,_numberKernel::NEG},
+            {"not",ScriptOperator::UNARY,_numberKernel::NOT},
+        };
+        std::vector<_internalEntry> ret;
+        for(auto& [name,type,kernel] : defaults) {
+            for(auto& i : default_script_operators.at(name)) {
+                if(i.type == type) ret.push_back({i.run,type,kernel});
+            }
+        }
+        return ret;
+    }();
+    for(auto& i : entries) {
+        if(i.run == run && i.type == type) return i.kernel;
+    }
+    return _numberKernel::NONE;
+}
+
+// a column of numbers, split like the fields of `ScriptNumberValue`
+struct _numberColumn {
+    std::vector<long double> number;
+    std::vector<long long> integer;
+    std::vector<unsigned char> is_integer;
+
+    _numberColumn(size_t rows = 0): number(rows), integer(rows), is_integer(rows) {}
+
+    inline void set_integer(size_t i, long long value) noexcept {
+        number[i] = (long double)value;
+        integer[i] = value;
+        is_integer[i] = true;
+    }
+    inline void set_number(size_t i, long double value) noexcept {
+        number[i] = value;
+        integer[i] = 0;
+        is_integer[i] = false;
+    }
+    inline void set(size_t i, const ScriptNumberValue& value) noexcept {
+        number[i] = value.number;
+        integer[i] = value.integer;
+        is_integer[i] = value.is_integer;
+    }
+    inline ScriptVariable get(size_t i) const noexcept {
+        if(is_integer[i]) return ScriptNumberValue::from_integer(integer[i]);
+        return new ScriptNumberValue(number[i]);
+    }
+};
+
+// `_number_operator` for every row, the result replaces `left`
+template<typename IntegerOp, typename FloatOp>
+inline static void _number_column_operator(_numberColumn& left, const _numberColumn& right, bool as_double, IntegerOp integer_op, FloatOp float_op) noexcept {
+    const size_t rows = left.number.size();
+    for(size_t i = 0; i < rows; ++i) {
+        long long result = 0;
+        if(left.is_integer[i] && right.is_integer[i] && integer_op(left.integer[i],right.integer[i],result)) {
+            left.set_integer(i,result);
+        }
+        else if(as_double) {
+            left.set_number(i,float_op((double)left.number[i],(double)right.number[i]));
+        }
+        else {
+            left.set_number(i,float_op(left.number[i],right.number[i]));
+        }
+    }
+}
+
+// runs a default binary operator on every row. Rows where it fails get marked in `failed`
+inline static void _number_column_binary(_numberKernel kernel, _numberColumn& left, const _numberColumn& right, std::vector<unsigned char>& failed, bool as_double) noexcept {
+    const size_t rows = left.number.size();
+    switch(kernel) {
+        case _numberKernel::ADD:
+            _number_column_operator(left,right,as_double,_integer_add,[](auto l, auto r) { return l + r; });
+            break;
+        case _numberKernel::SUB:
+            _number_column_operator(left,right,as_double,_integer_sub,[](auto l, auto r) { return l - r; });
+            break;
+        case _numberKernel::MUL:
+            _number_column_operator(left,right,as_double,_integer_mul,[](auto l, auto r) { return l * r; });
+            break;
+        case _numberKernel::DIV:
+            for(size_t i = 0; i < rows; ++i) {
+                if(right.number[i] == 0) failed[i] = true;
+            }
+            _number_column_operator(left,right,as_double,
+                [](long long l, long long r, long long& ret) { return r != 0 && _integer_div(l,r,ret); },
+                [](auto l, auto r) { return l / r; }
+            );
+            break;
+        case _numberKernel::POW:
+            _number_column_operator(left,right,as_double,_integer_pow,[](auto l, auto r) { return std::pow(l,r); });
+            break;
+        case _numberKernel::IS:
+            for(size_t i = 0; i < rows; ++i) left.set_integer(i,left.number[i] == right.number[i]);
+            break;
+        case _numberKernel::ISNT:
+            for(size_t i = 0; i < rows; ++i) left.set_integer(i,left.number[i] != right.number[i]);
+            break;
+        case _numberKernel::AND:
+            for(size_t i = 0; i < rows; ++i) left.set_integer(i,left.number[i] == true && right.number[i] != 0);
+            break;
+        case _numberKernel::OR:
+            for(size_t i = 0; i < rows; ++i) left.set_integer(i,left.number[i] == true || right.number[i] == true);
+            break;
+        case _numberKernel::MORE:
+            for(size_t i = 0; i < rows; ++i) {
+                left.set_integer(i,left.is_integer[i] && right.is_integer[i] ? left.integer[i] > right.integer[i] : left.number[i] > right.number[i]);
+            }
+            break;
+        case _numberKernel::LESS:
+            for(size_t i = 0; i < rows; ++i) {
+                left.set_integer(i,left.is_integer[i] && right.is_integer[i] ? left.integer[i] < right.integer[i] : left.number[i] < right.number[i]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+inline static void _number_column_unary(_numberKernel kernel, _numberColumn& operand) noexcept {
+    const size_t rows = operand.number.size();
+    switch(kernel) {
+        case _numberKernel::NEG:
+            for(size_t i = 0; i < rows; ++i) {
+                const long long value = operand.integer[i];
+                if(operand.is_integer[i] && value != 0 && value != std::numeric_limits<long long>::min()) operand.set_integer(i,-value);
+                else operand.set_number(i,operand.number[i] * -1);
+            }
+            break;
+        case _numberKernel::NOT:
+            for(size_t i = 0; i < rows; ++i) operand.set_integer(i,operand.number[i] == 0);
+            break;
+        default:
+            break;
+    }
+}
+
+// what `Interpreter::evaluate_batch` returns, one value per row.
+// Rows that failed are null and have their error in `errors`
+struct ScriptBatchResult {
+    std::vector<ScriptVariable> values;
+    std::vector<std::pair<size_t,std::string>> errors;
+};
+
+// an expression compiled by `Interpreter::compile_expression`, it belongs to that interpreter.
+// Adding or removing operators afterwards makes `evaluate_batch` evaluate it the usual way
+class ScriptExpression {
+    struct _internalStep {
+        enum { VALUE, SLOT, CAPSULE, UNARY, BINARY } kind = VALUE;
+        ScriptVariable value;
+        // the column of a SLOT, the program of a CAPSULE, the operator of UNARY and BINARY
+        size_t index = 0;
+        // BINARY: the left operand is a capsule, the interpreter evaluates it after the right one
+        bool lazy_left = false;
+        // UNARY: how many steps before it compute its operand
+        size_t operand = 0;
+    };
+    // the steps of the expression or of one of its capsules
+    struct _internalProgram {
+        std::string source;
+        // the capsule with its parentheses, for error messages
+        std::string capsule;
+        std::vector<_internalStep> steps;
+    };
+
+    std::string source_code;
+    std::vector<std::string> parameter_list;
+    // programs[0] is the whole expression
+    std::vector<_internalProgram> programs;
+    std::vector<_expressionToken> operators;
+    // overloads each operator had when it was compiled
+    std::vector<size_t> overload_counts;
+    bool is_compiled = false;
+    // all literals are numbers
+    bool number_literals = true;
+
+    friend class Interpreter;
+
+    static constexpr size_t _failed = (size_t)-1;
+
+    // the program for `source`, `_failed` if it can't be compiled
+    inline size_t _compile(const std::string& source, ScriptSettings& settings) noexcept {
+        auto lexed = settings.interpreter.lexer.p_expression(source);
+        _expressionErrors errors;
+        auto tokens = expression_prepare_tokens(lexed,settings,errors);
+        if(errors.changed() || tokens.empty()) return _failed;
+        if(tokens.size() == 1 && tokens[0].type == tokens[0].OP) return _failed;
+
+        // the operator types follow from their positions, like in `expression_force_parse`
+        for(size_t i = 0; i < tokens.size() && tokens.size() != 1; ++i) {
+            if(tokens[i].type != tokens[i].OP) {
+                if(++i >= tokens.size()) break;
+                if(tokens[i].type != tokens[i].OP) return _failed;
+                tokens[i].op.op.type = ScriptOperator::BINARY;
+            }
+            else {
+                tokens[i].op.op.type = ScriptOperator::UNARY;
+            }
+            _expressionToken& token = tokens[i].op;
+            const std::vector<ScriptOperator>& overloads = settings.interpreter.script_operators.at(token.tk);
+            const ScriptOperator* first = nullptr;
+            size_t candidates = 0;
+            for(auto& o : overloads) {
+                if(o.type != token.op.type) continue;
+                if(first == nullptr) first = &o;
+                // more than one way to parse it, that has to be tried out per row
+                else if(o.priority != first->priority) return _failed;
+                ++candidates;
+            }
+            if(first == nullptr) return _failed;
+            token.op = *first;
+            token.overloads = &overloads;
+            token.candidates = candidates;
+        }
+
+        const size_t program = programs.size();
+        programs.push_back({source,"",{}});
+        std::vector<_internalStep> steps;
+        size_t state = 0;
+        if(!_parse(tokens,state,999999999,steps,settings)) return _failed;
+        programs[program].steps = std::move(steps);
+        return program;
+    }
+
+    // `expression_check_prec` without evaluating anything
+    inline bool _parse(std::vector<_operatorToken>& tokens, size_t& state, int maxprec, std::vector<_internalStep>& out, ScriptSettings& settings) noexcept {
+        if(state >= tokens.size()) return false;
+        _operatorToken& lhs = tokens[state++];
+        std::vector<_internalStep> left;
+        bool lazy = false;
+        switch(lhs.type) {
+            case _operatorToken::OP: {
+                if(!_parse(tokens,state,lhs.op.op.priority,left,settings)) return false;
+                const bool lookup = lhs.op.candidates <= 1 && lhs.op.op.left_type == 0 && lhs.op.op.right_type == 0 &&
+                    _number_kernel_of(lhs.op.op.run,ScriptOperator::UNARY) == _numberKernel::LOOKUP;
+                if(lookup && left.size() == 1 && left[0].kind == _internalStep::VALUE && is_typeof<ScriptNameValue>(left[0].value)) {
+                    const std::string name = get_value<ScriptNameValue>(left[0].value);
+                    auto found = std::find(parameter_list.begin(),parameter_list.end(),name);
+                    if(found != parameter_list.end()) {
+                        left[0] = _internalStep{_internalStep::SLOT,script_null,(size_t)(found - parameter_list.begin())};
+                        break;
+                    }
+                }
+                left.push_back({_internalStep::UNARY,script_null,operators.size(),false,left.size()});
+                operators.push_back(lhs.op);
+            } break;
+            case _operatorToken::VAL:
+                // literals of other types (like lists) can read variables when they are converted
+                if(!is_typeof<ScriptNumberValue>(lhs.val) && !is_typeof<ScriptStringValue>(lhs.val) &&
+                    !is_typeof<ScriptNameValue>(lhs.val) && !is_typeof<ScriptNullValue>(lhs.val)) return false;
+                left.push_back({_internalStep::VALUE,lhs.val});
+                break;
+            case _operatorToken::CAPSULE: {
+                const size_t program = _compile(lhs.capsule.substr(1,lhs.capsule.size() - 2),settings);
+                if(program == _failed) return false;
+                programs[program].capsule = lhs.capsule;
+                left.push_back({_internalStep::CAPSULE,script_null,program});
+                lazy = true;
+            } break;
+            default:
+                return false;
+        }
+
+        while(state < tokens.size()) {
+            const _operatorToken& vop = tokens[state];
+            if(vop.type != vop.OP || vop.op.op.type != ScriptOperator::BINARY) return false;
+            if(vop.op.op.priority >= maxprec) break;
+            ++state;
+            std::vector<_internalStep> right;
+            if(!_parse(tokens,state,vop.op.op.priority,right,settings)) return false;
+            if(lazy) std::swap(left,right);
+            left.insert(left.end(),right.begin(),right.end());
+            left.push_back({_internalStep::BINARY,script_null,operators.size(),lazy});
+            operators.push_back(vop.op);
+            lazy = false;
+        }
+        out.insert(out.end(),left.begin(),left.end());
+        return true;
+    }
+
+    // false if the operators changed since it was compiled
+    inline bool _current(Interpreter& interpreter) const noexcept;
+
+    // runs `program` for one row, like `evaluate_expression` does
+    inline ScriptVariable _run(size_t program, size_t row, const std::vector<std::vector<ScriptVariable>>& columns, const std::vector<_expressionToken>& ops, ScriptSettings& settings, std::string& error) const noexcept {
+        _expressionErrors errors;
+        std::vector<ScriptVariable> stack;
+        const auto& steps = programs[program].steps;
+        for(size_t k = 0; k < steps.size(); ++k) {
+            const _internalStep& step = steps[k];
+            switch(step.kind) {
+                case _internalStep::VALUE:
+                    stack.push_back(step.value);
+                    break;
+                case _internalStep::SLOT:
+                    stack.push_back(columns[step.index][row]);
+                    break;
+                case _internalStep::CAPSULE: {
+                    std::string inner;
+                    stack.push_back(_run(step.index,row,columns,ops,settings,inner));
+                    if(inner != "") errors.push("Error while parsing " + programs[step.index].capsule + ": " + inner);
+                } break;
+                case _internalStep::UNARY: {
+                    ScriptVariable result = expression_apply(ops[step.index],stack.back(),script_null,settings,errors);
+                    stack.back().value = std::move(result.value);
+                } break;
+                case _internalStep::BINARY: {
+                    ScriptVariable top = std::move(stack.back());
+                    stack.pop_back();
+                    if(step.lazy_left) {
+                        ScriptVariable result = expression_apply(ops[step.index],top,stack.back(),settings,errors);
+                        stack.back().value = std::move(result.value);
+                    }
+                    else {
+                        stack.back() = expression_apply(ops[step.index],stack.back(),top,settings,errors);
+                    }
+                } break;
+            }
+            if(!errors.changed()) continue;
+            // unary operators still run on the null their failed operand gives them
+            for(size_t i = k + 1; i < steps.size(); ++i) {
+                if(steps[i].kind == _internalStep::UNARY && i - steps[i].operand <= k) {
+                    expression_apply(ops[steps[i].index],script_null,script_null,settings,errors);
+                }
+            }
+            break;
+        }
+
+        if(errors.changed() || is_null(stack.back())) {
+            error = "\nError in expression: " + programs[program].source + "\n";
+            for(auto& i : errors.messages) error += i + "\n";
+            if(!errors.messages.empty()) error.pop_back();
+            return script_null;
+        }
+        return std::move(stack.back());
+    }
+
+    // runs `program` on whole columns, the kernels say which operator does what
+    inline _numberColumn _run_numbers(size_t program, size_t rows, const std::vector<_numberColumn>& columns, const std::vector<_numberKernel>& kernels, std::vector<unsigned char>& failed, bool as_double) const noexcept {
+        std::vector<_numberColumn> stack;
+        for(auto& step : programs[program].steps) {
+            switch(step.kind) {
+                case _internalStep::VALUE: {
+                    const ScriptNumberValue& value = *(const ScriptNumberValue*)step.value.value.get();
+                    stack.emplace_back(rows);
+                    for(size_t i = 0; i < rows; ++i) stack.back().set(i,value);
+                } break;
+                case _internalStep::SLOT:
+                    stack.push_back(columns[step.index]);
+                    break;
+                case _internalStep::CAPSULE:
+                    stack.push_back(_run_numbers(step.index,rows,columns,kernels,failed,as_double));
+                    break;
+                case _internalStep::UNARY:
+                    _number_column_unary(kernels[step.index],stack.back());
+                    break;
+                case _internalStep::BINARY: {
+                    _numberColumn top = std::move(stack.back());
+                    stack.pop_back();
+                    if(step.lazy_left) std::swap(top,stack.back());
+                    _number_column_binary(kernels[step.index],stack.back(),top,failed,as_double);
+                } break;
+            }
+        }
+        return std::move(stack.back());
+    }
+public:
+    ScriptExpression() {}
+
+    inline const std::string& source() const noexcept { return source_code; }
+    inline const std::vector<std::string>& parameters() const noexcept { return parameter_list; }
+    // false if it gets evaluated the usual way for every row
+    inline bool compiled() const noexcept { return is_compiled; }
+};
+
+inline bool ScriptExpression::_current(Interpreter& interpreter) const noexcept {
+    for(size_t i = 0; i < operators.size(); ++i) {
+        auto found = interpreter.script_operators.find(operators[i].tk);
+        if(found == interpreter.script_operators.end() || &found->second != operators[i].overloads || found->second.size() != overload_counts[i]) return false;
+    }
+    return true;
+}
+
+inline ScriptExpression Interpreter::compile_expression(const std::string& source, std::vector<std::string> parameters) noexcept {
+    ScriptExpression ret;
+    ret.source_code = source;
+    ret.parameter_list = std::move(parameters);
+    ret.is_compiled = ret._compile(source,settings) == 0;
+    if(!ret.is_compiled) {
+        ret.programs.clear();
+        ret.operators.clear();
+        return ret;
+    }
+    for(auto& i : ret.operators) ret.overload_counts.push_back(i.overloads->size());
+    for(auto& program : ret.programs) {
+        for(auto& i : program.steps) {
+            if(i.kind == i.VALUE && !is_typeof<ScriptNumberValue>(i.value)) ret.number_literals = false;
+        }
+    }
+    return ret;
+}
+
+inline ScriptBatchResult Interpreter::evaluate_batch(const ScriptExpression& expression, const std::vector<std::vector<ScriptVariable>>& columns) noexcept {
+    ScriptBatchResult ret;
+    settings.error_msg = "";
+    const auto& parameters = expression.parameters();
+    if(columns.size() != parameters.size()) {
+        settings.error_msg = "evaluate_batch: expected " + std::to_string(parameters.size()) + " columns, got " + std::to_string(columns.size());
+        error_check();
+        return ret;
+    }
+    // without parameters it is evaluated once
+    const size_t rows = columns.empty() ? 1 : columns[0].size();
+    for(auto& i : columns) {
+        if(i.size() != rows) {
+            settings.error_msg = "evaluate_batch: the columns have different sizes";
+            error_check();
+            return ret;
+        }
+    }
+    budget.start();
+    ret.values.resize(rows);
+    auto fail = [&](size_t row, std::string error) {
+        ret.values[row] = script_null;
+        ret.errors.push_back({row,std::move(error)});
+    };
+
+    if(!expression.compiled() || !expression._current(*this)) {
+        // the parameters are variables while it runs
+        std::vector<std::pair<std::string,ScriptVariable>> shadowed;
+        for(auto& i : parameters) {
+            auto found = settings.variables.find(i);
+            if(found != settings.variables.end()) shadowed.push_back(*found);
+        }
+        for(size_t row = 0; row < rows; ++row) {
+            bool bound = true;
+            for(size_t i = 0; i < parameters.size() && bound; ++i) bound = settings.set_variable(parameters[i],columns[i][row]);
+            ScriptVariable value = bound ? evaluate_expression(expression.source(),settings) : script_null;
+            if(settings.error_msg != "") {
+                fail(row,settings.error_msg);
+                settings.error_msg = "";
+            }
+            else ret.values[row] = std::move(value);
+        }
+        for(auto& i : parameters) settings.erase_variable(i);
+        for(auto& [name,value] : shadowed) {
+            if(!settings.set_variable(name,value)) break;
+        }
+        output_sink->flush();
+        error_check();
+        return ret;
+    }
+
+    // every operator site of the expression, used for all rows
+    std::vector<_operatorSite> sites(expression.operators.size());
+    std::vector<_expressionToken> ops = expression.operators;
+    for(size_t i = 0; i < ops.size(); ++i) ops[i].site = &sites[i];
+
+    // rows the columns can't do (or that failed there) run one at a time
+    std::vector<unsigned char> failed(rows,true);
+    std::vector<_numberKernel> kernels;
+    bool numbers = expression.number_literals;
+    const size_t number_id = ScriptNumberValue::static_type_id;
+    for(size_t i = 0; i < ops.size() && numbers; ++i) {
+        const _expressionToken& token = ops[i];
+        const bool unary = token.op.type == ScriptOperator::UNARY;
+        auto run = token.op.run;
+        if(token.candidates > 1 || token.op.left_type != 0 || token.op.right_type != 0) {
+            const auto candidates = operator_cache.candidates(*token.overloads,token.op,number_id,unary ? _script_type_of(script_null) : number_id);
+            run = candidates->size() == 1 ? (*token.overloads)[candidates->front()].run : nullptr;
+        }
+        kernels.push_back(_number_kernel_of(run,token.op.type));
+        if(kernels.back() == _numberKernel::NONE || kernels.back() == _numberKernel::LOOKUP) numbers = false;
+    }
+    std::vector<_numberColumn> number_columns;
+    for(size_t i = 0; i < columns.size() && numbers; ++i) {
+        _numberColumn& column = number_columns.emplace_back(rows);
+        for(size_t row = 0; row < rows && numbers; ++row) {
+            const ScriptVariable& value = columns[i][row];
+            if(value.value == nullptr || !is_typeof<ScriptNumberValue>(value)) numbers = false;
+            else column.set(row,*(const ScriptNumberValue*)value.value.get());
+        }
+    }
+    if(numbers) {
+        std::fill(failed.begin(),failed.end(),false);
+        _numberColumn result = expression._run_numbers(0,rows,number_columns,kernels,failed,number_mode == ScriptNumberMode::DOUBLE);
+        for(size_t row = 0; row < rows; ++row) {
+            if(!failed[row]) ret.values[row] = result.get(row);
+        }
+    }
+
+    for(size_t row = 0; row < rows; ++row) {
+        if(!failed[row]) continue;
+        std::string error;
+        ScriptVariable value = expression._run(0,row,columns,ops,settings,error);
+        if(error != "") fail(row,std::move(error));
+        else ret.values[row] = std::move(value);
+    }
+    output_sink->flush();
+    return ret;
+}
+
+} /* namespace carescript */
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef CARESCRIPT_LEXER_HPP
+#define CARESCRIPT_LEXER_HPP
+
+#include <array>
+#include <string>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include "catpkgs/kittenlexer/kittenlexer.hpp"
+
+namespace carescript {
+
+// Hand-written scanners for the default lexers of `LexerCollection`.
+// They return the same tokens as the KittenLexer configurations there, but
+// classify every byte with a single table lookup and jump over the insides of
+// strings, capsules and comments 16 bytes at a time where SSE2 is available.
+
+enum class _lexClass : unsigned char {
+    PLAIN,
+    OPERATOR,
+    QUOTE,
+    OPEN,
+    IGNORE,
+    NEWLINE,
+    SKIP,
+    EXTRACT,
+};
+
+inline constexpr std::array<bool,256> _lex_operator_chars = []() {
+    std::array<bool,256> ret{};
+    for(const char* c = "+-*/^%$|&~?!><="; *c != '\0'; ++c) ret[(unsigned char)*c] = true;
+    return ret;
+}();
+
+struct _lexConfig {
+    std::array<_lexClass,256> classes{};
+    std::array<char,256> closers{};
+    // what a backslash sequence in a string turns into
+    std::array<char,256> escaped{};
+    // false keeps backslash sequences as they are written
+    bool escapes = false;
+
+    constexpr _lexConfig() {
+        for(size_t i = 0; i < escaped.size(); ++i) escaped[i] = (char)i;
+    }
+    constexpr _lexConfig& set(char c, _lexClass type) {
+        classes[(unsigned char)c] = type;
+        return *this;
+    }
+    constexpr _lexConfig& capsule(char open, char close) {
+        closers[(unsigned char)open] = close;
+        return set(open,_lexClass::OPEN);
+    }
+    constexpr _lexConfig& operators() {
+        for(size_t i = 0; i < classes.size(); ++i) {
+            if(_lex_operator_chars[i]) classes[i] = _lexClass::OPERATOR;
+        }
+        return *this;
+    }
+    constexpr _lexConfig& escape(char c, char to) {
+        escapes = true;
+        escaped[(unsigned char)c] = to;
+        return *this;
+    }
+};
+
+inline constexpr _lexConfig _lex_argumentlist = _lexConfig()
+    .capsule('(',')')
+    .capsule('[',']')
+    .capsule('{','}')
+    .set('"',_lexClass::QUOTE)
+    .set(' ',_lexClass::IGNORE)
+    .set('\t',_lexClass::IGNORE)
+    .set('\n',_lexClass::NEWLINE)
+    .operators()
+    .set(',',_lexClass::EXTRACT);
+
+// newlines stay PLAIN here and are part of the tokens
+inline constexpr _lexConfig _lex_expression = _lexConfig()
+    .set('"',_lexClass::QUOTE)
+    .capsule('(',')')
+    .capsule('[',']')
+    .capsule('{','}')
+    .operators()
+    .set(' ',_lexClass::IGNORE)
+    .set('\t',_lexClass::IGNORE)
+    .escape('t','\t')
+    .escape('n','\n')
+    .escape('r','\r')
+    .escape('\\','\\')
+    .escape('"','\"');
+
+inline constexpr _lexConfig _lex_preprocess = _lexConfig()
+    .set('"',_lexClass::QUOTE)
+    .capsule('(',')')
+    .capsule('[',']')
+    .set(' ',_lexClass::IGNORE)
+    .set('\t',_lexClass::IGNORE)
+    .set('\n',_lexClass::NEWLINE)
+    .set('#',_lexClass::SKIP)
+    .set('@',_lexClass::EXTRACT);
+
+// first of `a`, `b`, `c` or `d` in [p,end), `end` if there is none
+inline static const char* _lex_find(const char* p, const char* end, char a, char b, char c, char d) noexcept {
+#if defined(__SSE2__)
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    const __m128i vd = _mm_set1_epi8(d);
+    while(end - p >= 16) {
+        const __m128i x = _mm_loadu_si128((const __m128i*)p);
+        const int mask = _mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(x,va),_mm_cmpeq_epi8(x,vb)),
+            _mm_or_si128(_mm_cmpeq_epi8(x,vc),_mm_cmpeq_epi8(x,vd))));
+        if(mask != 0) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while(p < end && *p != a && *p != b && *p != c && *p != d) ++p;
+    return p;
+}
+
+inline static void _lex_push(lexed_kittens& ret, std::string src, bool str, unsigned long line) noexcept {
+    KittenToken token;
+    token.src = std::move(src);
+    token.str = str;
+    token.line = line;
+    ret.push_back(std::move(token));
+}
+
+inline static lexed_kittens _script_lex(const std::string& source, const _lexConfig& config) noexcept {
+    lexed_kittens ret;
+    const char* p = source.data();
+    const char* const end = p + source.size();
+    unsigned long line = 1;
+
+    while(p < end) {
+        const char* begin = p;
+        switch(config.classes[(unsigned char)*p]) {
+            case _lexClass::PLAIN:
+                do {
+                    if(*p == '\n') ++line;
+                    ++p;
+                } while(p < end && config.classes[(unsigned char)*p] == _lexClass::PLAIN);
+                _lex_push(ret,std::string(begin,p),false,line);
+                break;
+            case _lexClass::OPERATOR:
+                do ++p;
+                while(p < end && config.classes[(unsigned char)*p] == _lexClass::OPERATOR);
+                _lex_push(ret,std::string(begin,p),false,line);
+                break;
+            case _lexClass::QUOTE: {
+                std::string str;
+                ++p;
+                while(p < end) {
+                    const char* stop = _lex_find(p,end,'"','\\','\n','"');
+                    str.append(p,stop);
+                    p = stop;
+                    if(p == end) break;
+                    if(*p == '"') {
+                        ++p;
+                        break;
+                    }
+                    if(*p == '\n') {
+                        ++line;
+                        str += '\n';
+                        ++p;
+                    }
+                    // a backslash at the very end is just a backslash
+                    else if(p + 1 == end) {
+                        str += '\\';
+                        ++p;
+                    }
+                    else {
+                        if(config.escapes) str += config.escaped[(unsigned char)p[1]];
+                        else str.append(p,2);
+                        p += 2;
+                    }
+                }
+                _lex_push(ret,std::move(str),true,line);
+            } break;
+            case _lexClass::OPEN: {
+                // quotes only toggle, backslashes don't escape them inside capsules
+                const char open = *p;
+                const char close = config.closers[(unsigned char)open];
+                const unsigned long first = line;
+                long depth = 0;
+                bool string = false;
+                while(p < end) {
+                    p = _lex_find(p,end,'"',open,close,'\n');
+                    if(p == end) break;
+                    const char c = *p++;
+                    if(c == '\n') ++line;
+                    else if(c == '"') string = !string;
+                    else if(string) continue;
+                    else if(c == open) ++depth;
+                    else if(--depth == 0) break;
+                }
+                _lex_push(ret,std::string(begin,p),false,first);
+            } break;
+            case _lexClass::IGNORE:
+                ++p;
+                break;
+            case _lexClass::NEWLINE:
+                ++line;
+                ++p;
+                break;
+            case _lexClass::SKIP:
+                p = _lex_find(p,end,'\n','\n','\n','\n');
+                break;
+            case _lexClass::EXTRACT:
+                _lex_push(ret,std::string(1,*p),false,line);
+                ++p;
+                break;
+        }
+    }
+    return ret;
+}
+
+// same tokens as `LexerCollection::argumentlist`
+inline static lexed_kittens script_lex_argumentlist(const std::string& source) noexcept {
+    return _script_lex(source,_lex_argumentlist);
+}
+// same tokens as `LexerCollection::expression`
+inline static lexed_kittens script_lex_expression(const std::string& source) noexcept {
+    return _script_lex(source,_lex_expression);
+}
+// same tokens as `LexerCollection::preprocess`
+inline static lexed_kittens script_lex_preprocess(const std::string& source) noexcept {
+    return _script_lex(source,_lex_preprocess);
+}
+
+} /* namespace carescript */
+
+#endif
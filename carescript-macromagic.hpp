@@ -25,7 +25,7 @@
         auto _rg = (variable); \
         _cc_error("argument " #variable " is not allowed to match any of these types: "  _cc_chain(__VA_ARGS__) " (got: " + ((_rg)).get_type() + ")"); \
     } else do {} while (0)
-#define cc_builtin_same_type(variable1, variable2) if((variable1).get_type() != (variable2).get_type()) {\
+#define cc_builtin_same_type(variable1, variable2) if((variable1).type_id() != (variable2).type_id()) {\
         auto _rg1 = (variable1); \
         auto _rg2 = (variable2); \
         _cc_error(#variable1 " and "#variable2 " must have the same type (" #variable1 ": " + (_rg1).get_type() + " | " #variable2 ": " + (_rg2).get_type() + ")");\
@@ -40,12 +40,14 @@
 #define cc_builtin_arg_max(args, maximum) _cc_error_if(args.size() > maximum,\
         "argument maximum is reached (maximum: " + std::to_string(maximum) + " got: " + std::to_string(args.size()) + ")"\
     )
+// makes the interpreter run the current statement again once `ready` returns true
+#define cc_builtin_await(ready) do { settings.await = (ready); return carescript::script_null; } while(0)
 #define cc_builtin_if_ignore() do{ if(!settings.should_run.empty() && !settings.should_run.top()) return script_null; }while(0)
 #define cc_operator_var_requires(variable, op, ...) \
     if(_cc_eval(_cc_requires1(variable, __VA_ARGS__))) { \
         _cc_error(op ": " #variable " doesn't match any of these types: "  _cc_chain(__VA_ARGS__) " (got: " + (variable).get_type() + ")"); \
     } else do {} while (0)
-#define cc_operator_same_type(variable1, variable2, op) if((variable1).get_type() != (variable2).get_type()) {\
+#define cc_operator_same_type(variable1, variable2, op) if((variable1).type_id() != (variable2).type_id()) {\
         _cc_error(#op ": " #variable1 " and "#variable2 " must have the same type (" #variable1 ": " + (variable1).get_type() + " | " #variable2 ": " + (variable2).get_type() + ")");\
     } else do {} while (0)
 #define _cc_requires1(variable, type1, ...) _cc_second(__VA_OPT__(,) _cc_requires2(variable, type1, __VA_ARGS__), _cc_requires3(variable, type1))
@@ -3,10 +3,13 @@
 
 #include "carescript-defs.hpp"
 #include "carescript-defaults.hpp"
+#include "carescript-threads.hpp"
 
 #include <string.h>
 #include <filesystem>
 #include <variant>
+#include <array>
+#include <algorithm>
 
 // Implementation for the functions declared in "carescript-defs.hpp"
 
@@ -22,15 +25,52 @@ inline static ExtensionData get_ext(std::filesystem::path name) noexcept { retur
 #elif defined(__linux__)
 # include <dlfcn.h>
 namespace carescript {
+// an opened extension library, closed when the last extension made by it is gone
+struct ExtensionLibrary {
+    void* handle = nullptr;
+    get_extension_fun create = nullptr;
+    // null for libraries built before `destroy_extension` existed
+    destroy_extension_fun destroy = nullptr;
+
+    ExtensionLibrary(void* h): handle(h) {}
+    ExtensionLibrary(const ExtensionLibrary&) = delete;
+    ExtensionLibrary& operator=(const ExtensionLibrary&) = delete;
+    ~ExtensionLibrary() { dlclose(handle); }
+};
+
+// the process-wide registry: every library is opened and resolved once, no
+// matter how many interpreters bake it. Values of types from a library must
+// not outlive the last interpreter that uses it, the library is unloaded then
+inline std::shared_ptr<ExtensionLibrary> extension_library(const std::string& name) noexcept {
+    static std::mutex mutex;
+    static std::unordered_map<std::string,std::weak_ptr<ExtensionLibrary>> libraries;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::weak_ptr<ExtensionLibrary>& entry = libraries[name];
+    if(auto library = entry.lock()) return library;
+
+    void* handle = dlopen(name.c_str(),RTLD_NOW);
+    if(handle == nullptr) return nullptr;
+    auto library = std::make_shared<ExtensionLibrary>(handle);
+    library->create = (get_extension_fun)dlsym(handle,"get_extension");
+    if(library->create == nullptr) return nullptr;
+    library->destroy = (destroy_extension_fun)dlsym(handle,"destroy_extension");
+    entry = library;
+    return library;
+}
+
 inline static ExtensionData get_ext(std::filesystem::path name) noexcept {
     if(!name.has_extension()) name += ".so";
     if(name.is_relative())
         name = "./" + name.string();
-    void* handler = dlopen(name.c_str(),RTLD_NOW);
-    if(handler == nullptr) return {0,nullptr};
-    get_extension_fun f = (get_extension_fun)dlsym(handler,"get_extension");
-    if(f == nullptr) return {0,nullptr};
-    return f();
+    auto library = extension_library(name.string());
+    if(library == nullptr) return {0,nullptr};
+    ExtensionData ext = library->create();
+    if(ext.extension == nullptr) return ext;
+    ext.owner = std::shared_ptr<Extension>(ext.extension,[library](Extension* extension) {
+        if(library->destroy) library->destroy(extension);
+        else delete extension;
+    });
+    return ext;
 }
 #endif
 
@@ -44,9 +84,11 @@ inline static bool bake_extension(ExtensionData ext, ScriptSettings& settings) n
     for(auto i : t_list) settings.interpreter.script_typechecks.push_back(i);
     OperatorList o_list = ext.extension->get_operators();
     for(auto i : o_list) {
+        auto& overloads = settings.interpreter.script_operators[i.first];
         for(auto j : i.second) {
-            settings.interpreter.script_operators[i.first].push_back(j);
+            overloads.push_back(j);
         }
+        settings.interpreter.operator_cache.build(overloads);
     }
     MacroList m_list = ext.extension->get_macros();
     settings.interpreter.script_macros.insert(m_list.begin(),m_list.end());
@@ -54,118 +96,509 @@ inline static bool bake_extension(ExtensionData ext, ScriptSettings& settings) n
     settings.interpreter.script_preprocesses.insert(p_list.begin(),p_list.end());
     RawBuiltinList r_list = ext.extension->get_rawbuiltins();
     settings.interpreter.script_rawbuiltins.insert(r_list.begin(),r_list.end());
+    NativeLabelList n_list = ext.extension->get_native_labels();
+    for(auto& i : n_list) settings.interpreter.native_labels[i.first] = i.second;
 
+    if(ext.owner == nullptr) ext.owner.reset(ext.extension);
     settings.interpreter.extensions.push_back(ext);
+    ++settings.interpreter.tables_version;
     ext.extension->poke_interpreter(settings.interpreter);
     return true;
 }
 
+// a statically linked extension with the name or the file name (without the
+// extension) of `name`, so scripts baking "path/to/list.so" can use "list" too
+inline static get_extension_fun get_static_ext(const std::string& name) noexcept {
+    auto& extensions = static_extensions();
+    if(extensions.empty()) return nullptr;
+    auto it = extensions.find(name);
+    if(it == extensions.end()) it = extensions.find(std::filesystem::path(name).stem().string());
+    return it == extensions.end() ? nullptr : it->second;
+}
+
 inline static bool bake_extension(const std::string& name, ScriptSettings& settings) noexcept {
+    if(get_extension_fun create = get_static_ext(name)) return bake_extension(create(),settings);
     ExtensionData ext = get_ext(name);
     return bake_extension(ext,settings);
 }
 
+// snippets that only define labels can be reused from `Interpreter::eval_cache`
+inline static bool script_eval_cacheable(const std::string& source) noexcept {
+    for(auto& i : pre_process_chunks(source)) {
+        if(i.kind != PreProcessChunk::PRELUDE && i.kind != PreProcessChunk::LABEL) return false;
+    }
+    return true;
+}
+
 inline static std::string run_script(const std::string& source,ScriptSettings& settings) noexcept {
-    auto labels = pre_process(source,settings);
+    ScriptEvalCache& cache = settings.interpreter.eval_cache;
+    // the snippet replaces the labels, its pragmas mark them again
+    settings.interpreter.memo.reset();
+    const size_t version = settings.interpreter.table_version();
+    auto labels = cache.lookup(source,version);
+    if(labels == nullptr) {
+        auto processed = pre_process(source,settings);
+        if(settings.error_msg == "") {
+            labels = std::make_shared<const std::map<std::string,ScriptLabel>>(std::move(processed));
+            if(script_eval_cacheable(source)) cache.store(source,version,labels);
+        }
+    }
     if(settings.error_msg != "") {
         return settings.error_msg;
     }
     settings.line = 1;
-    std::string ret = run_label("main",labels,settings,std::filesystem::current_path().parent_path(),{});
+    settings.labels = *labels;
+    if(&settings == &settings.interpreter.settings) settings.interpreter.labels_changed(labels);
+    std::string ret = _run_label("main",labels,settings,std::filesystem::current_path().parent_path(),{});
     settings.exit = false;
     return ret;
 }
 
-inline static std::string run_label(const std::string& label_name, std::map<std::string,ScriptLabel> labels, ScriptSettings& settings, const std::filesystem::path& parent_path, const std::vector<ScriptVariable>& args) noexcept {
-    if(labels.empty() || labels.count(label_name) == 0) return "";
-    ScriptLabel label = labels[label_name];
-    std::vector<lexed_kittens> lines;
+// identifies the code of a label, independent of where it is in the source
+inline static size_t script_label_hash(const ScriptLabel& label) noexcept {
+    size_t hash = 14695981039346656037ull;
+    auto add = [&](const void* data, size_t size) {
+        for(size_t i = 0; i < size; ++i) {
+            hash ^= ((const unsigned char*)data)[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    for(auto& i : label.arglist) add(i.data(),i.size() + 1);
+    for(auto& i : label.lines) {
+        const long long line = (long long)i.line - label.line;
+        add(&line,sizeof(line));
+        add(&i.str,sizeof(i.str));
+        add(i.src.data(),i.src.size() + 1);
+    }
+    return hash;
+}
+
+// splits a label into its statements, once for every `codes`
+inline static const _labelCode& label_code(_labelCodes& codes, const std::string& label_name, const ScriptLabel& label, ScriptSettings& settings) noexcept {
+    auto found = codes.find(label_name);
+    if(found != codes.end()) return found->second;
+    _labelCode& code = codes[label_name];
     long long line = -1;
-    for(auto i : label.lines) {
+    for(auto& i : label.lines) {
         if((long long)i.line != line) {
             line = i.line;
-            lines.push_back({});
+            code.lines.push_back({});
         }
-        lines.back().push_back(i);
+        code.lines.back().push_back(i);
     }
-    settings.label.push(label_name);
-    for(auto i : lines) 
+    auto native = settings.interpreter.native_labels.find(label_name);
+    if(native != settings.interpreter.native_labels.end() && native->second.hash == script_label_hash(label))
+        code.native = native->second;
+    for(auto& i : code.lines) 
         if(i.size() != 2 || i[0].str || i[1].str || i[1].src.front() != '(') { 
-            settings.label.pop();
-            return "line " + std::to_string(i.front().line) + " is invalid (in label " + label_name + ")"; 
+            code.error = "line " + std::to_string(i.front().line) + " is invalid (in label " + label_name + ")"; 
+            break;
         }
+    return code;
+}
 
+// prepares running a label, returns false if there is nothing to run
+// (`error` is set if that's because of an invalid line)
+inline static bool run_label_setup(_labelFrame& frame, _labelCodes& codes, const std::string& label_name, const std::map<std::string,ScriptLabel>& labels, ScriptSettings& settings, const std::filesystem::path& parent_path, const std::vector<ScriptVariable>& args, std::string& error) noexcept {
+    auto label = labels.find(label_name);
+    if(label == labels.end()) return false;
+    const _labelCode& code = label_code(codes,label_name,label->second,settings);
+    if(code.error != "") {
+        error = code.error;
+        return false;
+    }
+    frame.name = label_name;
+    frame.label = &label->second;
+    frame.lines = code.lines;
+    frame.native = code.native;
+    settings.label.push(label_name);
     settings.parent_path = parent_path;
-    settings.labels = labels;
 
     for(size_t i = 0; i < args.size(); ++i) {
-        settings.variables[label.arglist[i]] = args[i];
+        if(!settings.set_variable(frame.label->arglist[i],args[i])) {
+            settings.label.pop();
+            error = settings.error_msg + " (in label " + label_name + ")";
+            return false;
+        }
     }
     if(settings.line == 0) settings.line = 1;
-    for(size_t i = settings.line-1; i < lines.size(); ++i) {
-        if(settings.exit) return "";
-        std::string name = lines[i][0].src;
-        if(settings.interpreter.has_rawbuiltin(name)) {
-            ScriptRawBuiltin rawbuiltin = settings.interpreter.get_rawbuiltin(name);
-            std::string r = lines[i][1].src;
-            r.erase(r.begin());
-            r.pop_back();
+    settings.resumed = false;
+    return true;
+}
 
-            rawbuiltin(r,settings);
+// error for a run that got stopped by `Interpreter::budget`, `settings.line` is where it can resume
+inline static std::string budget_error(const _labelFrame& frame, const ScriptSettings& settings) noexcept {
+    return "line " + std::to_string(settings.line + frame.label->line) + ": " + script_budget_exhausted + " (in label " + frame.name + ")";
+}
 
-            if(settings.error_msg != "") {
-                settings.label.pop();
-                if(settings.raw_error) return settings.error_msg;
-                return "line " + std::to_string(settings.line + label.line) + ": " + settings.error_msg + " (in label " + label_name + ")";
-            }
-            i = settings.line-1;
-            ++settings.line;
-            continue;
-        }
-        auto arglist = parse_argumentlist(lines[i][1].src,settings);
-        if(settings.error_msg != "") {
-            settings.label.pop();
-            if(settings.raw_error) return settings.error_msg;
-            return "line " + std::to_string(settings.line + label.line) + ": " + settings.error_msg + " (in label " + label_name + ")";
-        }
-        if(settings.interpreter.script_builtins.count(name) == 0) {
-            settings.label.pop();
-            return "line " + std::to_string(settings.line + label.line) + ": unknown function: " + name + " (in label " + label_name + ")";
-        }
-        ScriptBuiltin builtin = settings.interpreter.script_builtins[name];
-        if(builtin.arg_count != (int)arglist.size() && builtin.arg_count >= 0) {
-            settings.label.pop();
-            return "line " + std::to_string(lines[i][0].line + label.line) + " " + name + " has invalid argument count " + " (in label " + label_name + ")";
+// counts a step run with `settings`, false once the budget is used up. A statement that runs
+// again after a `call` counted its steps the first time, they count again after its results
+inline static bool script_tick(ScriptSettings& settings) noexcept {
+    ScriptBudget& budget = settings.interpreter.budget;
+    if(!budget.limited()) return true;
+    _scriptFrame* frame = _frameStack::frame_of(settings);
+    if(frame == nullptr) return budget.tick();
+    if(frame->replaying()) return !budget.exhausted.load(std::memory_order_relaxed);
+    return budget.tick(&frame->stack->budget);
+}
+
+// turns `settings.error_msg` into the error of the label, `prefix` goes in front of the message
+inline static _statementResult run_label_failed(_labelFrame& frame, ScriptSettings& settings, std::string& error, const std::string& prefix = "") noexcept {
+    settings.label.pop();
+    if(settings.interpreter.budget.exhausted) error = budget_error(frame,settings);
+    else if(settings.raw_error) error = settings.error_msg;
+    else error = "line " + std::to_string(settings.line + frame.label->line) + ": " + prefix + settings.error_msg + " (in label " + frame.name + ")";
+    return _statementResult::FAILED;
+}
+
+// runs a raw builtin as the current statement
+inline static _statementResult run_label_rawcall(_labelFrame& frame, ScriptSettings& settings, std::string& error, const ScriptRawBuiltin& rawbuiltin, std::string arguments) noexcept {
+    rawbuiltin(arguments,settings);
+    settings.resumed = false;
+
+    if(settings.error_msg != "") return run_label_failed(frame,settings,error);
+    if(settings.await) return _statementResult::AWAIT;
+    ++settings.line;
+    return _statementResult::NEXT;
+}
+
+// runs a builtin (nullptr if there is none called `name`) with the evaluated
+// arguments as the current statement. `line` is the line of the statement
+inline static _statementResult run_label_call(_labelFrame& frame, ScriptSettings& settings, std::string& error, const ScriptBuiltin* builtin, const std::string& name, const ScriptArglist& arglist, size_t line) noexcept {
+    if(settings.error_msg != "") return run_label_failed(frame,settings,error);
+    // something in the arguments has to wait, so don't run the builtin with an incomplete value
+    if(settings.await) return _statementResult::AWAIT;
+    if(builtin == nullptr) {
+        settings.label.pop();
+        error = "line " + std::to_string(settings.line + frame.label->line) + ": unknown function: " + name + " (in label " + frame.name + ")";
+        return _statementResult::FAILED;
+    }
+    if(builtin->arg_count != (int)arglist.size() && builtin->arg_count >= 0) {
+        settings.label.pop();
+        error = "line " + std::to_string(line + frame.label->line) + " " + name + " has invalid argument count " + " (in label " + frame.name + ")";
+        return _statementResult::FAILED;
+    }
+    builtin->exec(arglist,settings);
+    settings.resumed = false;
+    if(settings.error_msg != "") return run_label_failed(frame,settings,error,name + ": ");
+    if(settings.await) return _statementResult::AWAIT;
+    ++settings.line;
+    return _statementResult::NEXT;
+}
+
+// runs the statement at `settings.line`. AWAIT means a builtin set `settings.await`,
+// the statement has to be run again once that returns true
+inline static _statementResult run_label_step(_labelFrame& frame, ScriptSettings& settings, std::string& error) noexcept {
+    const size_t i = settings.line-1;
+    if(i >= frame.lines.size()) {
+        settings.label.pop();
+        return _statementResult::DONE;
+    }
+    if(settings.exit) return _statementResult::DONE;
+    if(!script_tick(settings)) {
+        settings.label.pop();
+        error = budget_error(frame,settings);
+        return _statementResult::FAILED;
+    }
+    if(frame.native.step != nullptr) return frame.native.step(frame,settings,error);
+
+    auto& lines = frame.lines;
+    std::string name = lines[i][0].src;
+    if(settings.interpreter.has_rawbuiltin(name)) {
+        std::string r = lines[i][1].src;
+        r.erase(r.begin());
+        r.pop_back();
+        return run_label_rawcall(frame,settings,error,settings.interpreter.get_rawbuiltin(name),r);
+    }
+    auto arglist = parse_argumentlist(lines[i][1].src,settings);
+    auto builtin = settings.interpreter.script_builtins.find(name);
+    return run_label_call(frame,settings,error,builtin == settings.interpreter.script_builtins.end() ? nullptr : &builtin->second,name,arglist,lines[i][0].line);
+}
+
+inline void _scriptFrame::record(const ScriptVariable& value, const std::string& error) noexcept {
+    // the statement fails once the budget is used up, `resume` has to run the rest of it again
+    if(stack->preemptible && settings->interpreter.budget.exhausted.load(std::memory_order_relaxed)) return;
+    results.push_back({value,error});
+    ++next_result;
+}
+
+inline _scriptFrame& _frameStack::push(ScriptSettings* settings, bool deep) noexcept {
+    if(size == frames.size()) frames.push_back(std::make_unique<_scriptFrame>());
+    _scriptFrame& frame = *frames[size++];
+    frame.stack = this;
+    frame.deep = deep;
+    attach(frame,settings);
+    return frame;
+}
+
+inline void _frameStack::attach(_scriptFrame& frame, ScriptSettings* settings) noexcept {
+    frame.settings = settings;
+    if(settings != nullptr) settings->running.frame = &frame;
+}
+
+inline void _frameStack::share_labels(ScriptSettings& settings) noexcept {
+    // those of the interpreter are where `labels` come from
+    if(&settings == &settings.interpreter.settings || settings.labels_of == labels) return;
+    settings.labels = *labels;
+    settings.labels_of = labels;
+}
+
+inline void _frameStack::pop() noexcept {
+    _scriptFrame& frame = *frames[--size];
+    if(frame.settings != nullptr) frame.settings->running.frame = nullptr;
+    // frees the variables of a label started by `call`, like destroying its settings would.
+    // The labels stay for the next label at this depth
+    if(frame.settings == frame.own.get()) {
+        auto labels = std::move(frame.own->labels);
+        auto labels_of = std::move(frame.own->labels_of);
+        frame.own->clear();
+        frame.own->labels = std::move(labels);
+        frame.own->labels_of = std::move(labels_of);
+    }
+    frame.args.clear();
+    frame.results.clear();
+}
+
+// the pending `call` of the frame on top starts
+inline void _frameStack::_start_pending() noexcept {
+    pending.active = false;
+    _scriptFrame& caller = top();
+    caller.settings->await = nullptr;
+    _scriptFrame& callee = push(nullptr,true);
+    if(callee.own == nullptr) callee.own = std::make_unique<ScriptSettings>(caller.settings->interpreter);
+    attach(callee,callee.own.get());
+    share_labels(*callee.settings);
+    callee.settings->constants = caller.settings->constants;
+    callee.args = std::move(pending.args);
+    std::string error;
+    if(!run_label_setup(callee.frame,codes,pending.label,*labels,*callee.settings,"",callee.args,error)) _finish(pending.label,error);
+}
+
+// the frame on top is done, its result goes to the statement that called it
+inline void _frameStack::_finish(const std::string& label_name, const std::string& error) noexcept {
+    _scriptFrame& callee = top();
+    ScriptVariable value = callee.settings->return_value;
+    if(error == "") callee.settings->interpreter.memo.store(label_name,callee.args,value);
+    pop();
+    top().results.push_back({std::move(value),error});
+}
+
+inline std::string _frameStack::run(size_t until) noexcept {
+    ++nested;
+    std::string error;
+    while(true) {
+        _scriptFrame& frame = top();
+        frame.next_result = 0;
+        const _statementResult result = run_label_step(frame.frame,*frame.settings,error);
+        switch(result) {
+            case _statementResult::NEXT:
+                frame.results.clear();
+                if(slice != 0 && ++steps >= slice) {
+                    steps = 0;
+                    suspended = true;
+                    --nested;
+                    return "";
+                }
+                break;
+            case _statementResult::AWAIT: {
+                if(pending.active) {
+                    _start_pending();
+                    break;
+                }
+                if(slice != 0) {
+                    steps = 0;
+                    waiting = std::move(frame.settings->await);
+                    frame.settings->await = nullptr;
+                    suspended = true;
+                    --nested;
+                    return "";
+                }
+                // can't suspend here, so block until the builtin is ready
+                auto ready = std::move(frame.settings->await);
+                frame.settings->await = nullptr;
+                script_wait_until(ready);
+                frame.settings->resumed = true;
+            } break;
+            default:
+                if(preemptible && result == _statementResult::FAILED && frame.settings->interpreter.budget.exhausted) {
+                    // the results of the statement stay for `resume`
+                    suspended = true;
+                    --nested;
+                    return error;
+                }
+                frame.results.clear();
+                if(overflow) {
+                    if(overflow_error == "") overflow_error = error;
+                    while(size - 1 > until) pop();
+                    --nested;
+                    return overflow_error;
+                }
+                if(size - 1 == until) {
+                    --nested;
+                    return error;
+                }
+                _finish(frame.frame.name,error);
+                error.clear();
         }
-        builtin.exec(arglist,settings);
-        if(settings.error_msg != "") {
-            settings.label.pop();
-            if(settings.raw_error) return settings.error_msg;
-            return "line " + std::to_string(settings.line + label.line) + ": " + name + ": " + settings.error_msg + " (in label " + label_name + ")";
+    }
+}
+
+inline std::string _frameStack::resume() noexcept {
+    // undo what the failed statement did to its frame
+    _scriptFrame& frame = top();
+    pending.active = false;
+    frame.settings->await = nullptr;
+    frame.settings->error_msg = "";
+    frame.settings->raw_error = false;
+    frame.settings->label.push(frame.frame.name);
+    suspended = false;
+    return run(0);
+}
+
+// runs a label on a new `_frameStack`, `settings` is the one of its first frame
+inline static std::string _run_label(const std::string& label_name, std::shared_ptr<const std::map<std::string,ScriptLabel>> labels, ScriptSettings& settings, const std::filesystem::path& parent_path, const std::vector<ScriptVariable>& args) noexcept {
+    _frameStack stack;
+    stack.labels = std::move(labels);
+    _frameStack* previous = _frameStack::current;
+    if(previous != nullptr) {
+        stack.base = previous->depth();
+        stack.nested = previous->nested;
+    }
+    // `settings` may already run a frame, e.g. for `eval` in a label
+    _scriptFrame* outer = settings.running.frame;
+    _scriptFrame& root = stack.push(&settings,stack.nested + 1 >= _frameStack::max_nested);
+    stack.share_labels(settings);
+    std::string error;
+    if(run_label_setup(root.frame,stack.codes,label_name,*stack.labels,settings,parent_path,args,error)) {
+        _frameStack::current = &stack;
+        error = stack.run(0);
+        _frameStack::current = previous;
+    }
+    settings.running.frame = outer;
+    return error;
+}
+
+inline static std::string run_label(const std::string& label_name, const std::map<std::string,ScriptLabel>& labels, ScriptSettings& settings, const std::filesystem::path& parent_path, const std::vector<ScriptVariable>& args) noexcept {
+    if(labels.count(label_name) == 0) return "";
+    // a copy, `settings.labels` may get replaced while the label runs
+    Interpreter& interp = settings.interpreter;
+    auto shared = &labels == &interp.settings.labels ? interp.shared_labels() : std::make_shared<const std::map<std::string,ScriptLabel>>(labels);
+    if(&labels != &settings.labels) {
+        settings.labels = labels;
+        settings.labels_of = shared;
+    }
+    return _run_label(label_name,std::move(shared),settings,parent_path,args);
+}
+
+inline static std::string run_label_preemptible(const std::string& label_name, ScriptSettings& settings, const std::vector<ScriptVariable>& args, std::unique_ptr<_frameStack>& preempted) noexcept {
+    preempted = nullptr;
+    Interpreter& interp = settings.interpreter;
+    if(!interp.budget.limited()) return run_label(label_name,settings.labels,settings,"",args);
+    if(settings.labels.count(label_name) == 0) return "";
+
+    // only deep frames, so every label that runs is kept on the heap
+    auto stack = std::make_unique<_frameStack>();
+    stack->labels = interp.shared_labels();
+    stack->preemptible = true;
+    _scriptFrame* outer = settings.running.frame;
+    _scriptFrame& root = stack->push(&settings,true);
+    std::string error;
+    if(!run_label_setup(root.frame,stack->codes,label_name,*stack->labels,settings,"",args,error)) {
+        settings.running.frame = outer;
+        return error;
+    }
+    preempted = std::move(stack);
+    return run_preempted(settings,preempted);
+}
+
+inline static std::string run_preempted(ScriptSettings& settings, std::unique_ptr<_frameStack>& preempted) noexcept {
+    if(preempted == nullptr) return script_not_resumable;
+    _frameStack& stack = *preempted;
+    _frameStack* previous = _frameStack::current;
+    if(previous != nullptr) {
+        stack.base = previous->depth();
+        stack.nested = previous->nested;
+    }
+    _scriptFrame* outer = settings.running.frame;
+    stack.attach(*stack.frames[0],&settings);
+    _frameStack::current = &stack;
+    std::string error = stack.suspended ? stack.resume() : stack.run(0);
+    _frameStack::current = previous;
+    settings.running.frame = outer;
+    if(!stack.suspended) preempted = nullptr;
+    return error;
+}
+
+inline static const std::map<std::string,ScriptLabel>& script_labels(const ScriptSettings& settings) noexcept {
+    _scriptFrame* frame = _frameStack::frame_of(settings);
+    return frame == nullptr ? settings.labels : *frame->stack->labels;
+}
+
+inline static std::shared_ptr<const std::map<std::string,ScriptLabel>> script_shared_labels(ScriptSettings& settings) noexcept {
+    if(_scriptFrame* frame = _frameStack::frame_of(settings)) return frame->stack->labels;
+    if(&settings == &settings.interpreter.settings) return settings.interpreter.shared_labels();
+    return std::make_shared<const std::map<std::string,ScriptLabel>>(settings.labels);
+}
+
+inline static ScriptVariable script_call(const std::string& label_name, const std::vector<ScriptVariable>& args, ScriptSettings& settings) noexcept {
+    Interpreter& interp = settings.interpreter;
+    _scriptFrame* caller = _frameStack::frame_of(settings);
+    // the statement runs again after the label finished
+    if(caller != nullptr && caller->replaying()) {
+        auto& result = caller->replay();
+        if(result.error != "") {
+            settings.error_msg = result.error;
+            settings.raw_error = true;
         }
-        i = settings.line-1;
-        ++settings.line;
+        return result.value;
     }
-    settings.label.pop();
-    return "";
+    ScriptVariable memoized;
+    if(interp.memo.lookup(label_name,args,memoized)) return memoized;
+
+    if(caller == nullptr) {
+        // not run by `run_label` (e.g. by `Interpreter::run_async`), so it gets a stack of its own
+        ScriptSettings tset(interp);
+        tset.constants = settings.constants;
+        settings.error_msg = run_label(label_name,settings.labels,tset,"",args);
+        if(settings.error_msg != "") settings.raw_error = true;
+        else interp.memo.store(label_name,args,tset.return_value);
+        return tset.return_value;
+    }
+    _frameStack* stack = caller->stack;
+    if(stack->depth() >= interp.max_call_depth) {
+        stack->overflow = true;
+        settings.error_msg = "call depth limit reached (" + std::to_string(interp.max_call_depth) + ")";
+        return script_null;
+    }
+    if(caller->deep) {
+        stack->pending.active = true;
+        stack->pending.label = label_name;
+        stack->pending.args = args;
+        settings.await = []{ return true; };
+        return script_null;
+    }
+
+    _scriptFrame& callee = stack->push(nullptr,stack->nested + 1 >= _frameStack::max_nested);
+    if(callee.own == nullptr) callee.own = std::make_unique<ScriptSettings>(interp);
+    stack->attach(callee,callee.own.get());
+    stack->share_labels(*callee.settings);
+    callee.settings->constants = settings.constants;
+    std::string error;
+    if(run_label_setup(callee.frame,stack->codes,label_name,*stack->labels,*callee.settings,"",args,error)) {
+        error = stack->run(stack->size - 1);
+    }
+    ScriptVariable ret = callee.settings->return_value;
+    stack->pop();
+    if(error != "") {
+        settings.error_msg = error;
+        settings.raw_error = true;
+    }
+    else interp.memo.store(label_name,args,ret);
+    return ret;
 }
 
 inline static bool is_operator_char(char c) noexcept {
-    return c == '+' ||
-           c == '-' ||
-           c == '*' ||
-           c == '/' ||
-           c == '^' ||
-           c == '%' ||
-           c == '$' ||
-           c == '|' ||
-           c == '&' ||
-           c == '~' ||
-           c == '?' ||
-           c == '!' ||
-           c == '>' ||
-           c == '<' ||
-           c == '=';
+    return _lex_operator_chars[(unsigned char)c];
 }
 
 inline static bool is_name_char(char c) noexcept {
@@ -176,12 +609,7 @@ inline static bool is_name_char(char c) noexcept {
 }
 
 inline static bool is_name(const std::string& s) noexcept {
-    if(s.empty()) return false;
-    try { 
-        std::stoi(std::string(1,s[0]));
-        return false;
-    }
-    catch(...) {}
+    if(s.empty() || (s[0] >= '0' && s[0] <= '9')) return false;
     for(auto i : s) {
         if(!is_name_char(i)) return false;
     }
@@ -290,14 +718,48 @@ struct _expressionErrors {
 
     inline operator std::vector<std::string>() const noexcept { return messages; }
 };
-struct _expressionToken { std::string tk; ScriptOperator op; };
+struct _expressionToken {
+    std::string tk;
+    ScriptOperator op;
+    // all overloads of `tk`, `op` is the first one with its type and priority
+    const std::vector<ScriptOperator>* overloads = nullptr;
+    // how many of them have the type and priority of `op`
+    size_t candidates = 0;
+    _operatorSite* site = nullptr;
+};
 struct _expressionFuncall { 
     std::string function; 
     std::string arguments; 
 
     inline ScriptVariable call(ScriptSettings& settings, _expressionErrors& errors) noexcept {
+        // something else in the statement has to wait, it runs again later anyway
+        if(settings.await) return script_null;
+        // a statement of a deep frame runs again after each `call`, the builtins it
+        // already ran hand out their results from before instead of running again.
+        // They are in the order the builtins returned, so after their arguments
+        _scriptFrame* frame = _frameStack::frame_of(settings);
+        if(frame != nullptr && !frame->deep) frame = nullptr;
+        auto replayed = [&]() {
+            return frame != nullptr && frame->replaying();
+        };
+        auto replay = [&]() {
+            auto& result = frame->replay();
+            if(result.error != "") {
+                settings.error_msg = result.error;
+                settings.raw_error = true;
+                errors.push(settings.error_msg);
+            }
+            return result.value;
+        };
+        auto record = [&](const ScriptVariable& value) {
+            if(frame == nullptr || settings.await) return;
+            frame->record(value);
+        };
         if(settings.interpreter.has_builtin(function)) {
             ScriptArglist args = parse_argumentlist(arguments,settings);
+            // the arguments aren't complete
+            if(settings.await) return script_null;
+            if(replayed()) return replay();
             ScriptBuiltin fun = settings.interpreter.get_builtin(function);
             if(settings.error_msg != "") {
                 errors.push("error parsing argumentlist: " + settings.error_msg);
@@ -319,9 +781,11 @@ struct _expressionFuncall {
             settings.error_msg = "";
             ScriptVariable ret =  fun.exec(args,settings);
             if(settings.error_msg != "") errors.push(settings.error_msg);
+            else record(ret);
             return ret;
         }
         else {
+            if(replayed()) return replay();
             ScriptRawBuiltin rawbuiltin = settings.interpreter.get_rawbuiltin(function);
             std::string argcpy = arguments.substr(1,arguments.size()-2);
             auto ret = rawbuiltin(argcpy,settings);
@@ -330,6 +794,7 @@ struct _expressionFuncall {
                 settings.error_msg = "";
                 return script_null;
             }
+            record(ret);
             return ret;
         }
     }
@@ -411,20 +876,100 @@ inline static std::vector<_operatorToken> expression_prepare_tokens(lexed_kitten
     return ret;
 }
 
+inline static size_t _script_type_of(const ScriptVariable& var) noexcept {
+    return var.value == nullptr ? 0 : var.value->type_id();
+}
+
+// runs the operator `token` on the operands. If several overloads share the type and priority
+// it got parsed with, the first one taking the operand types and running without an error
+// wins. The site of the token remembers that overload for the operand types, so a site
+// seeing the same types again calls it right away
+inline static ScriptVariable expression_run_operator(const _expressionToken& token, const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings, _expressionErrors& errors) noexcept {
+    auto message = [&]() {
+        std::string ret = token.op.type == ScriptOperator::UNARY ? settings.error_msg : left.printable() + " " + token.tk + " " + right.printable() + ": " + settings.error_msg;
+        settings.error_msg = "";
+        return ret;
+    };
+    if(token.overloads == nullptr || (token.candidates <= 1 && token.op.left_type == 0 && token.op.right_type == 0)) {
+        ScriptVariable ret = token.op.run(left,right,settings);
+        if(settings.error_msg != "") {
+            errors.push(message());
+            return script_null;
+        }
+        return ret;
+    }
+
+    const std::vector<ScriptOperator>& overloads = *token.overloads;
+    const size_t left_type = _script_type_of(left);
+    const size_t right_type = _script_type_of(right);
+    _operatorSite* site = token.site;
+    std::vector<std::string> failed;
+    size_t tried = overloads.size();
+    if(site != nullptr && site->overloads == &overloads && site->left == left_type && site->right == right_type &&
+        site->index < overloads.size() && overloads[site->index].run == site->run) {
+        ScriptVariable ret = site->run(left,right,settings);
+        if(settings.error_msg == "") return ret;
+        tried = site->index;
+        failed.push_back(message());
+    }
+
+    const auto candidates = settings.interpreter.operator_cache.candidates(overloads,token.op,left_type,right_type);
+    for(size_t i : *candidates) {
+        if(i == tried) continue;
+        const auto run = overloads[i].run;
+        ScriptVariable ret = run(left,right,settings);
+        if(settings.error_msg == "") {
+            if(site != nullptr) *site = _operatorSite{&overloads,i,left_type,right_type,run};
+            return ret;
+        }
+        failed.push_back(message());
+    }
+    if(failed.empty()) {
+        settings.error_msg = "no overload of " + token.tk + " takes " + left.get_type();
+        if(token.op.type != ScriptOperator::UNARY) settings.error_msg += " and " + right.get_type();
+        failed.push_back(message());
+    }
+    for(auto& i : failed) errors.push(i);
+    return script_null;
+}
+
+// runs the operator of `token`. In a statement of a deep frame that runs again
+// after a `call` it hands out its result from before, like builtins do
+inline static ScriptVariable expression_apply(const _expressionToken& token, const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings, _expressionErrors& errors) noexcept {
+    _scriptFrame* frame = _frameStack::frame_of(settings);
+    if(frame == nullptr || !frame->deep) return expression_run_operator(token,left,right,settings,errors);
+    // something in the statement has to wait, it runs again later anyway
+    if(settings.await) return script_null;
+    if(frame->replaying()) {
+        auto& result = frame->replay();
+        if(result.error != "") errors.push(result.error);
+        return result.value;
+    }
+    const size_t before = errors.messages.size();
+    ScriptVariable ret = expression_run_operator(token,left,right,settings,errors);
+    std::string error;
+    for(size_t i = before; i < errors.messages.size(); ++i) error += (i == before ? "" : "\n") + errors.messages[i];
+    frame->record(ret,error);
+    return ret;
+}
+
 inline static ScriptVariable expression_check_prec(std::vector<_operatorToken> markedupTokens, int& state, const int& maxprec, ScriptSettings& settings, _expressionErrors& errors) noexcept {
     if(errors.changed()) return script_null;
     if(state >= (int)markedupTokens.size()) {
         errors.push("Unexpected end of expression");
         return script_null;
     }
+    // the rest of a statement that has to wait counts once it runs again
+    if(!settings.await && !script_tick(settings)) {
+        errors.push(script_budget_exhausted);
+        return script_null;
+    }
     _operatorToken lhs = markedupTokens[state++];
         
     if(lhs.type == lhs.OP) {
-        lhs = lhs.op.op.run(expression_check_prec(markedupTokens, state, lhs.op.op.priority, settings, errors),script_null,settings);
-        if(settings.error_msg != "") {
-            errors.push(settings.error_msg); 
-            settings.error_msg = "";
-        } 
+        const _expressionToken unary = lhs.op;
+        ScriptVariable operand = expression_check_prec(markedupTokens, state, unary.op.priority, settings, errors);
+        lhs = expression_apply(unary,operand,script_null,settings,errors);
         if(errors.changed()) return script_null;
     }
 
@@ -448,12 +993,8 @@ inline static ScriptVariable expression_check_prec(std::vector<_operatorToken> m
         ScriptVariable old_lhs = lhs.get_val(settings,errors);
         if(errors.changed()) return script_null;
         lhs.type = lhs.VAL;
-        lhs.val = op.run(old_lhs, rhs, settings);
-        if(settings.error_msg != "") {
-            errors.push(old_lhs.printable() + " " + vop.op.tk + " " + rhs.printable() + ": " + settings.error_msg);
-            settings.error_msg = "";
-            return script_null;
-        }
+        lhs.val = expression_apply(vop.op,old_lhs,rhs,settings,errors);
+        if(errors.changed()) return script_null;
     }
     return lhs.get_val(settings,errors);
 }
@@ -498,14 +1039,26 @@ inline static ScriptVariable expression_force_parse(std::vector<_operatorToken>
         markedupTokens[i].op.op.type = ScriptOperator::BINARY;
     }
 
-    for(auto option : settings.interpreter.script_operators[markedupTokens[i].op.tk]) {
+    const auto& overloads = settings.interpreter.script_operators[markedupTokens[i].op.tk];
+    for(size_t o = 0; o < overloads.size(); ++o) {
+        const ScriptOperator& option = overloads[o];
         settings.error_msg = "";
         auto op = markedupTokens[i].op.op;
         if(option.type != op.type)
             continue;
+        // overloads with the same priority parse the same way, `expression_apply` picks one of them
+        size_t candidates = 0;
+        bool parsed = false;
+        for(size_t k = 0; k < overloads.size(); ++k) {
+            if(overloads[k].type != option.type || overloads[k].priority != option.priority) continue;
+            if(k < o) parsed = true;
+            ++candidates;
+        }
+        if(parsed) continue;
         auto newMarkedupTokens = markedupTokens;
-        newMarkedupTokens[i].op.op.priority = option.priority;
-        newMarkedupTokens[i].op.op.run = option.run;
+        newMarkedupTokens[i].op.op = option;
+        newMarkedupTokens[i].op.overloads = &overloads;
+        newMarkedupTokens[i].op.candidates = candidates;
         auto test = expression_force_parse(newMarkedupTokens, settings, errors, i + 1);
         if(!is_null(test) && !errors.changed()) {
             return test;
@@ -515,11 +1068,37 @@ inline static ScriptVariable expression_force_parse(std::vector<_operatorToken>
     return script_null;
 }
 
+// gives every operator token its site in `Interpreter::operator_cache`
+inline static void expression_attach_sites(const std::string& source, std::vector<_operatorToken>& tokens, ScriptSettings& settings) noexcept {
+    size_t count = 0;
+    for(auto& i : tokens) {
+        if(i.type == i.OP) ++count;
+    }
+    if(count == 0) return;
+
+    ScriptOperatorCache& cache = settings.interpreter.operator_cache;
+    if(cache.shared.load(std::memory_order_relaxed) != 0) return;
+    auto found = cache.sites.find(source);
+    if(found == cache.sites.end()) {
+        if(cache.sites.size() >= cache.max_expressions) return;
+        found = cache.sites.emplace(source,std::vector<_operatorSite>(count)).first;
+    }
+    // sites can be in use further up the stack, so they are never resized
+    if(found->second.size() != count) return;
+    size_t site = 0;
+    for(auto& i : tokens) {
+        if(i.type == i.OP) i.op.site = &found->second[site++];
+    }
+}
+
 inline static ScriptVariable evaluate_expression(const std::string& source, ScriptSettings& settings) noexcept {
     auto lexed = settings.interpreter.lexer.p_expression(source);
     _expressionErrors errors;
 
-    auto result = expression_force_parse(expression_prepare_tokens(lexed,settings,errors),settings,errors);
+    auto tokens = expression_prepare_tokens(lexed,settings,errors);
+    expression_attach_sites(source,tokens,settings);
+    auto result = expression_force_parse(std::move(tokens),settings,errors);
+    if(settings.await) return script_null;
 
     if(errors.changed() || is_null(result)) {
         settings.error_msg = "\nError in expression: " + source + "\n";
@@ -532,7 +1111,7 @@ inline static ScriptVariable evaluate_expression(const std::string& source, Scri
     return result;
 }
 
-inline static void parse_const_preprog(const std::string& source, ScriptSettings& settings) noexcept {
+inline static void parse_const_preprog(const std::string& source, ScriptSettings& settings, std::vector<std::string>* names) noexcept {
     std::vector<lexed_kittens> lines;
     KittenLexer lexer = KittenLexer()
         .add_stringq('"')
@@ -568,136 +1147,618 @@ inline static void parse_const_preprog(const std::string& source, ScriptSettings
             line += i[j].src + " ";
         }
         line.pop_back();
-        settings.constants[name] = evaluate_expression(line,settings);
+        ScriptVariable value = evaluate_expression(line,settings);
         if(settings.error_msg != "") {
             return;
         }
+        settings.set_constant(name,value);
+        if(names) names->push_back(name);
     }
 }
 
-inline static std::map<std::string,ScriptLabel> pre_process(const std::string& source, ScriptSettings& settings) noexcept {
-    std::map<std::string,ScriptLabel> ret;
-    
-    auto lexed = settings.interpreter.lexer.p_preprocess(source);
+// groups tokens by the line they are on
+inline static std::vector<lexed_kittens> split_lines(const lexed_kittens& lexed) noexcept {
     std::vector<lexed_kittens> lines;
     long long line = -1;
-    for(auto i : lexed) {
+    for(auto& i : lexed) {
         if((long long)i.line != line) {
             line = i.line;
             lines.push_back({});
         }
         lines.back().push_back(i);
     }
+    return lines;
+}
 
+// state that's carried from line to line while pre processing
+struct _preprocessState {
+    std::map<std::string,ScriptLabel> labels;
     std::string current_label = "main";
-    for(size_t i = 0; i < lines.size(); ++i) {
-        auto& line = lines[i];
-        if(line.size() != 0 && line[0].src == "@" && !line[0].str) {
-            if(line.size() != 3 && (line.size() > 1 && line[1].src != "pragma")) {
-                settings.error_msg = "line " + std::to_string(i+1) + ": invalid pre processor instruction: must have 2 arguments (got: " + std::to_string(line.size()-1) + ")";
-                return {};
+    // number of lines in front of the ones currently processed
+    size_t line_offset = 0;
+    // extensions that are already baked and don't need to be baked again
+    std::unordered_set<std::string>* baked = nullptr;
+    // names of the constants set by `@const` blocks, if given
+    std::vector<std::string>* constants = nullptr;
+};
+
+// handles the i-th line, returns false and sets the error message on failure
+inline static bool pre_process_line(std::vector<lexed_kittens>& lines, size_t i, _preprocessState& state, ScriptSettings& settings) noexcept {
+    const size_t lnum = state.line_offset + i + 1;
+    auto& line = lines[i];
+    if(line.size() != 0 && line[0].src == "@" && !line[0].str) {
+        if(line.size() != 3 && (line.size() > 1 && line[1].src != "pragma")) {
+            settings.error_msg = "line " + std::to_string(lnum) + ": invalid pre processor instruction: must have 2 arguments (got: " + std::to_string(line.size()-1) + ")";
+            return false;
+        }
+        if(!is_name(line[1].src) || line[1].str) {
+            settings.error_msg = "line " + std::to_string(lnum) + ": invalid pre processor instruction: expected instruction";
+            return false;
+        }
+        std::string inst = line[1].src;
+
+        if(inst == "const") {
+            auto body = line[2].src;
+            if(line[2].str) {
+                settings.error_msg = "line " + std::to_string(lnum) + ": const: unexpected string";
+                return false;
             }
-            if(!is_name(line[1].src) || line[1].str) {
-                settings.error_msg = "line " + std::to_string(i+1) + ": invalid pre processor instruction: expected instruction";
-                return {};
+            if(body.size() < 2) {
+                settings.error_msg = "line " + std::to_string(lnum) + ": const: unexpected token";
+                return false;
             }
-            std::string inst = line[1].src;
-
-            if(inst == "const") {
-                auto body = line[2].src;
-                if(line[2].str) {
-                    settings.error_msg = "line " + std::to_string(i+1) + ": const: unexpected string";
-                    return {};
-                }
-                if(body.size() < 2) {
-                    settings.error_msg = "line " + std::to_string(i+1) + ": const: unexpected token";
-                    return {};
-                }
-                if(body.front() != '[' || body.back() != ']') {
-                    settings.error_msg = "line " + std::to_string(i+1) + ": const: expected body";
-                    return {};
+            if(body.front() != '[' || body.back() != ']') {
+                settings.error_msg = "line " + std::to_string(lnum) + ": const: expected body";
+                return false;
+            }
+            body.erase(body.begin());
+            body.erase(body.end()-1);
+            parse_const_preprog(body,settings,state.constants);
+            if(settings.error_msg != "") {
+                settings.error_msg = "line " + std::to_string(lnum) + ": const: line " + std::to_string(settings.line) + ": " + settings.error_msg;
+                return false;
+            }
+        }
+        else if(inst == "bake") {
+            KittenLexer bake_lexer = KittenLexer()
+                .add_stringq('"')
+                .erase_empty()
+                .add_ignore(' ')
+                .add_ignore('\t')
+                .add_ignore('\n')
+                ;
+            auto body = line[2].src;
+            if(line[2].str) {
+                settings.error_msg = "line " + std::to_string(lnum) + ": bake: unexpected string";
+                return false;
+            }
+            if(body.size() < 2) {
+                settings.error_msg = "line " + std::to_string(lnum) + ": bake: unexpected token";
+                return false;
+            }
+            if(body.front() != '[' || body.back() != ']') {
+                settings.error_msg = "line " + std::to_string(lnum) + ": bake: expected body";
+                return false;
+            }
+            body.erase(body.begin());
+            body.erase(body.end()-1);
+            auto lexed = bake_lexer.lex(body);
+            for(auto b : lexed) {
+                if(!b.str) {
+                    settings.error_msg = "line " + std::to_string(lnum) + ": bake: expected value: " + b.src;
+                    return false;
                 }
-                body.erase(body.begin());
-                body.erase(body.end()-1);
-                parse_const_preprog(body,settings);
-                if(settings.error_msg != "") {
-                    settings.error_msg = "line " + std::to_string(i+1) + ": const: line " + std::to_string(settings.line) + ": " + settings.error_msg;
-                    return {};
+                if(state.baked != nullptr && state.baked->count(b.src) != 0) continue;
+                if(!bake_extension(b.src,settings)) {
+                    const char* reason = dlerror();
+                    settings.error_msg = "line " + std::to_string(lnum) + ": bake: error baking extension: " + b.src + "\n" + (reason ? reason : ""); 
+                    return false;
                 }
+                if(state.baked != nullptr) state.baked->insert(b.src);
             }
-            else if(inst == "bake") {
-                KittenLexer bake_lexer = KittenLexer()
-                    .add_stringq('"')
-                    .erase_empty()
-                    .add_ignore(' ')
-                    .add_ignore('\t')
-                    .add_ignore('\n')
-                    ;
-                auto body = line[2].src;
-                if(line[2].str) {
-                    settings.error_msg = "line " + std::to_string(i+1) + ": bake: unexpected string";
-                    return {};
-                }
-                if(body.size() < 2) {
-                    settings.error_msg = "line " + std::to_string(i+1) + ": bake: unexpected token";
-                    return {};
+        }
+        else if(inst == "pragma") {
+            line.erase(line.begin(),line.begin()+2);
+            if(line.size() == 0) {
+                settings.error_msg = "line " + std::to_string(lnum) + ": pragma: no instruction";
+                return false;
+            }
+            if(line[0].str || settings.interpreter.script_preprocesses.count(line[0].src) == 0) {
+                settings.error_msg = "line " + std::to_string(lnum) + ": pragma: unknown instruction";
+                return false;
+            }
+            auto proc = settings.interpreter.script_preprocesses[line[0].src];
+            line.erase(line.begin());
+            proc(line,lines,i,settings);
+            if(settings.error_msg != "") {
+                settings.error_msg = "line " + std::to_string(lnum) + ": pragma: " + settings.error_msg;
+                return false;
+            }
+        }
+        else if(is_label_arglist(line[2].src) && !line[2].str) {
+            if(state.labels.count(line[1].src) != 0) {
+                settings.error_msg = "line " + std::to_string(lnum) + ": can't open label twice: " + line[1].src;
+                return false;
+            }
+            state.current_label = line[1].src;
+            state.labels[state.current_label].arglist = parse_label_arglist(line[2].src);
+            state.labels[state.current_label].line = line[1].line;
+        }
+        else {
+            settings.error_msg = "line " + std::to_string(lnum) + ": invalid pre processor instruction: no match for: " + inst;
+            return false;
+        }
+    }
+    else {
+        auto& label_lines = state.labels[state.current_label].lines;
+        label_lines.insert(label_lines.end(),line.begin(),line.end());
+    }
+    return true;
+}
+
+inline static std::vector<PreProcessChunk> pre_process_chunks(const std::string& source) noexcept;
+inline static std::vector<lexed_kittens> pre_process_lex_chunk(const std::string& source, const PreProcessChunk& chunk, ScriptSettings& settings) noexcept;
+
+// sources smaller than this aren't worth spreading over multiple threads
+inline constexpr size_t _preprocess_parallel_min = 64 * 1024;
+
+inline static bool pre_process_use_threads(const std::string& source, ScriptSettings& settings) noexcept {
+    return settings.interpreter.parallel_pre_process && source.size() >= _preprocess_parallel_min && script_thread_pool().size() > 1;
+}
+
+// false for a pragma chunk that may change the lines after it (see `Interpreter::local_pragmas`)
+inline static bool pre_process_local(const std::string& source, const PreProcessChunk& chunk, ScriptSettings& settings) noexcept {
+    if(chunk.kind != PreProcessChunk::PRAGMA) return true;
+    size_t begin = source.find("pragma",chunk.begin) + 6;
+    while(begin < chunk.end && (source[begin] == ' ' || source[begin] == '\t')) ++begin;
+    size_t end = begin;
+    while(end < chunk.end && is_name_char(source[end])) ++end;
+    return settings.interpreter.local_pragmas.count(source.substr(begin,end - begin)) != 0;
+}
+
+// lexes every chunk, on multiple threads
+inline static std::vector<std::vector<lexed_kittens>> pre_process_lex_parallel(const std::string& source, const std::vector<PreProcessChunk>& chunks, ScriptSettings& settings) noexcept {
+    std::vector<std::vector<lexed_kittens>> lexed(chunks.size());
+    script_thread_pool().parallel_for(chunks.size(),[&](size_t i) {
+        lexed[i] = pre_process_lex_chunk(source,chunks[i],settings);
+    });
+    return lexed;
+}
+
+// lexes every label on its own thread, the pre processor lines are still
+// handled in source order afterwards, so @const and @bake behave the same
+inline static bool pre_process_parallel(const std::string& source, _preprocessState& state, ScriptSettings& settings) noexcept {
+    auto chunks = pre_process_chunks(source);
+    for(auto& i : chunks) {
+        if(!pre_process_local(source,i,settings)) return false;
+    }
+
+    auto lexed = pre_process_lex_parallel(source,chunks,settings);
+
+    for(auto& lines : lexed) {
+        for(size_t i = 0; i < lines.size(); ++i) {
+            if(!pre_process_line(lines,i,state,settings)) {
+                state.labels.clear();
+                return true;
+            }
+        }
+        state.line_offset += lines.size();
+    }
+    return true;
+}
+
+inline static std::map<std::string,ScriptLabel> pre_process(const std::string& source, ScriptSettings& settings) noexcept {
+    _preprocessState state;
+    if(pre_process_use_threads(source,settings)) {
+        if(pre_process_parallel(source,state,settings)) return std::move(state.labels);
+    }
+
+    auto lines = split_lines(settings.interpreter.lexer.p_preprocess(source));
+    for(size_t i = 0; i < lines.size(); ++i) {
+        if(!pre_process_line(lines,i,state,settings)) return {};
+    }
+
+    return std::move(state.labels);
+}
+
+inline constexpr std::array<bool,256> _preprocess_special_chars = []() {
+    std::array<bool,256> ret{};
+    ret['\n'] = ret['"'] = ret['#'] = ret['('] = ret['['] = true;
+    return ret;
+}();
+
+// scans for pre processor lines, starting at `from` which has to be the start of a line
+// outside of any capsule. Before a new chunk is added `stop` gets asked if the scan can end
+template<typename Fn>
+inline static std::vector<PreProcessChunk> pre_process_scan(const std::string& source, size_t from, size_t newlines, Fn stop) noexcept {
+    std::vector<PreProcessChunk> ret(1);
+    ret[0].begin = from;
+    ret[0].newlines = newlines;
+    const char* src = source.data();
+    const size_t size = source.size();
+
+    auto skip_string = [&](size_t& i) {
+        for(++i; i < size && src[i] != '"'; ++i) {
+            if(src[i] == '\\' && i + 1 < size) ++i;
+            if(src[i] == '\n') ++newlines;
+        }
+    };
+
+    size_t i = from;
+    bool line_start = true;
+    while(i < size) {
+        if(line_start) {
+            line_start = false;
+            size_t n = i;
+            while(n < size && (src[n] == ' ' || src[n] == '\t')) ++n;
+            if(n < size && src[n] == '@') {
+                PreProcessChunk chunk;
+                chunk.begin = i;
+                chunk.newlines = newlines;
+
+                ++n;
+                while(n < size && (src[n] == ' ' || src[n] == '\t')) ++n;
+                size_t name_begin = n;
+                while(n < size && is_name_char(src[n])) ++n;
+                std::string_view inst(src + name_begin, n - name_begin);
+                if(inst == "const") chunk.kind = PreProcessChunk::CONST;
+                else if(inst == "bake") chunk.kind = PreProcessChunk::BAKE;
+                else if(inst == "pragma") chunk.kind = PreProcessChunk::PRAGMA;
+                else {
+                    chunk.kind = PreProcessChunk::LABEL;
+                    chunk.name = inst;
                 }
-                if(body.front() != '[' || body.back() != ']') {
-                    settings.error_msg = "line " + std::to_string(i+1) + ": bake: expected body";
-                    return {};
+
+                ret.back().end = i;
+                if(stop(chunk)) return ret;
+                ret.push_back(std::move(chunk));
+            }
+            i = n;
+        }
+        while(i < size && !_preprocess_special_chars[(unsigned char)src[i]]) ++i;
+        if(i >= size) break;
+
+        switch(src[i]) {
+            case '\n':
+                ++newlines;
+                line_start = true;
+                break;
+            case '"':
+                skip_string(i);
+                break;
+            case '#': {
+                const void* found = memchr(src + i, '\n', size - i);
+                i = found == nullptr ? size : (const char*)found - src - 1;
+            } break;
+            default: {
+                // capsules only nest with their own kind
+                const char open = src[i];
+                const char close = open == '(' ? ')' : ']';
+                int depth = 1;
+                for(++i; i < size; ++i) {
+                    if(src[i] == open) ++depth;
+                    else if(src[i] == close) { if(--depth == 0) break; }
+                    else if(src[i] == '"') skip_string(i);
+                    else if(src[i] == '\n') ++newlines;
                 }
-                body.erase(body.begin());
-                body.erase(body.end()-1);
-                auto lexed = bake_lexer.lex(body);
-                for(auto b : lexed) {
-                    if(!b.str) {
-                        settings.error_msg = "line " + std::to_string(i+1) + ": bake: expected value: " + b.src;
-                        return {};
-                    }
-                    if(!bake_extension(b.src,settings)) {
-                        settings.error_msg = "line " + std::to_string(i+1) + ": bake: error baking extension: " + b.src + "\n" + dlerror(); 
-                        return {};
-                    }
+            } break;
+        }
+        ++i;
+    }
+    ret.back().end = size;
+    return ret;
+}
+
+inline static std::vector<PreProcessChunk> pre_process_chunks(const std::string& source) noexcept {
+    return pre_process_scan(source,0,0,[](const PreProcessChunk&) { return false; });
+}
+
+// same as above, but only scans the part of the source that differs from the cached one
+inline static std::vector<PreProcessChunk> pre_process_chunks(const std::string& source, const PreProcessCache& cache) noexcept {
+    const std::string& old = cache.source;
+    const auto& old_chunks = cache.chunks;
+    if(!cache.valid || old_chunks.empty()) return pre_process_chunks(source);
+
+    const size_t common = std::min(old.size(),source.size());
+    size_t prefix = 0;
+    while(prefix + 64 <= common && memcmp(old.data() + prefix,source.data() + prefix,64) == 0) prefix += 64;
+    while(prefix < common && old[prefix] == source[prefix]) ++prefix;
+    size_t suffix = 0;
+    while(suffix + 64 <= common - prefix && memcmp(old.data() + old.size() - suffix - 64,source.data() + source.size() - suffix - 64,64) == 0) suffix += 64;
+    while(suffix < common - prefix && old[old.size() - suffix - 1] == source[source.size() - suffix - 1]) ++suffix;
+
+    // everything up to the last chunk starting in the common prefix stays the same
+    size_t restart = std::upper_bound(old_chunks.begin() + 1,old_chunks.end(),prefix,[](size_t pos, const PreProcessChunk& c) {
+        return pos < c.begin;
+    }) - old_chunks.begin() - 1;
+
+    const long long delta = (long long)source.size() - (long long)old.size();
+    const long long newline_delta =
+        (long long)std::count(source.begin() + prefix,source.end() - suffix,'\n') -
+        (long long)std::count(old.begin() + prefix,old.end() - suffix,'\n');
+
+    // chunk boundaries in the common suffix are the same as before, once one is found again the scan can stop
+    size_t resume = old_chunks.size();
+    auto scanned = pre_process_scan(source,restart == 0 ? 0 : old_chunks[restart].begin,restart == 0 ? 0 : old_chunks[restart].newlines,
+        [&](const PreProcessChunk& chunk) {
+            if(chunk.begin < source.size() - suffix) return false;
+            auto found = std::lower_bound(old_chunks.begin() + restart,old_chunks.end(),(size_t)(chunk.begin - delta),[](const PreProcessChunk& c, size_t pos) {
+                return c.begin < pos;
+            });
+            if(found == old_chunks.end() || found->begin != (size_t)(chunk.begin - delta)) return false;
+            resume = found - old_chunks.begin();
+            return true;
+        });
+
+    std::vector<PreProcessChunk> ret;
+    ret.reserve(old_chunks.size() + scanned.size());
+    ret.insert(ret.end(),old_chunks.begin(),old_chunks.begin() + restart);
+    if(restart == 0) ret.push_back(std::move(scanned[0]));
+    else if(scanned[0].end != scanned[0].begin) ret.back().end = scanned[0].end;
+    for(size_t i = 1; i < scanned.size(); ++i) ret.push_back(std::move(scanned[i]));
+    for(size_t i = resume; i < old_chunks.size(); ++i) {
+        ret.push_back(old_chunks[i]);
+        ret.back().begin += delta;
+        ret.back().end += delta;
+        ret.back().newlines += newline_delta;
+    }
+    return ret;
+}
+
+// lexes a single chunk, line numbers are the same as if the whole source was lexed
+inline static std::vector<lexed_kittens> pre_process_lex_chunk(const std::string& source, const PreProcessChunk& chunk, ScriptSettings& settings) noexcept {
+    auto lexed = settings.interpreter.lexer.p_preprocess(source.substr(chunk.begin,chunk.end - chunk.begin));
+    for(auto& i : lexed) i.line += chunk.newlines;
+    return split_lines(lexed);
+}
+
+inline static void shift_label_lines(ScriptLabel& label, long long delta) noexcept {
+    if(delta == 0) return;
+    label.line += delta;
+    for(auto& i : label.lines) i.line += delta;
+}
+
+// a label chunk together with the const and bake chunks following it,
+// as the lines after those still belong to the label
+struct _preprocessGroup {
+    size_t first = 0;
+    size_t last = 0;
+};
+
+inline static std::vector<_preprocessGroup> pre_process_groups(const std::vector<PreProcessChunk>& chunks) noexcept {
+    std::vector<_preprocessGroup> ret;
+    for(size_t i = 0; i < chunks.size(); ++i) {
+        if(ret.empty() || chunks[i].kind == PreProcessChunk::LABEL || chunks[i].kind == PreProcessChunk::PRELUDE)
+            ret.push_back({i,i});
+        ret.back().last = i + 1;
+    }
+    return ret;
+}
+
+struct _preprocessKeepConsts {
+    PreProcessCache& cache;
+    const std::vector<PreProcessChunk>& chunks;
+
+    ~_preprocessKeepConsts() {
+        if(cache.valid) return;
+        for(auto& i : chunks) {
+            if(i.kind == PreProcessChunk::CONST && !i.constants.empty()) cache.chunks.push_back(i);
+        }
+    }
+};
+
+// `settings.labels` is patched in place, only labels whose text changed get built again
+inline static std::map<std::string,ScriptLabel> pre_process_incremental(std::string source, ScriptSettings& settings, PreProcessCache& cache) noexcept {
+    auto chunks = pre_process_chunks(source,cache);
+    for(auto& i : chunks) {
+        if(!pre_process_local(source,i,settings)) {
+            // the pragma may rewrite any following line, so nothing can be reused
+            cache.clear();
+            return pre_process(source,settings);
+        }
+    }
+
+    const bool reuse = cache.valid;
+    cache.valid = false;
+    // if this fails, the next call has to know which constants got set until then
+    _preprocessKeepConsts keep_consts{cache,chunks};
+    auto groups = pre_process_groups(chunks);
+    auto old_group_list = pre_process_groups(cache.chunks);
+    auto same_text = [&](size_t begin, size_t end, size_t old_begin, size_t old_end) {
+        return end - begin == old_end - old_begin &&
+            cache.source.compare(old_begin,old_end - old_begin,source,begin,end - begin) == 0;
+    };
+    auto group_begin = [](const std::vector<PreProcessChunk>& c, const _preprocessGroup& g) { return c[g.first].begin; };
+    auto group_end = [](const std::vector<PreProcessChunk>& c, const _preprocessGroup& g) { return c[g.last-1].end; };
+    // lines in front of the first label, they go into "main"
+    auto stray_lines = [](const std::vector<PreProcessChunk>& c, const _preprocessGroup& g) {
+        size_t ret = 0;
+        for(size_t i = g.first; i < g.last; ++i) {
+            // every chunk but the prelude starts with its instruction
+            const size_t first = c[i].kind == PreProcessChunk::PRELUDE ? 0 : 1;
+            if(c[i].lines > first) ret += c[i].lines - first;
+        }
+        return ret;
+    };
+
+    _preprocessState state;
+    state.baked = &cache.baked;
+    if(reuse) state.labels = std::move(settings.labels);
+
+    std::vector<const PreProcessChunk*> old_consts;
+    for(auto& i : cache.chunks) {
+        if(i.kind == PreProcessChunk::CONST) old_consts.push_back(&i);
+    }
+    auto erase_old_consts = [&](size_t from) {
+        for(size_t i = from; i < old_consts.size(); ++i) {
+            for(auto& name : old_consts[i]->constants) settings.erase_constant(name);
+        }
+    };
+
+    // big sources without anything to reuse get lexed up front on multiple threads
+    std::vector<std::vector<lexed_kittens>> lexed;
+    if(!reuse && pre_process_use_threads(source,settings)) lexed = pre_process_lex_parallel(source,chunks,settings);
+
+    // old groups whose label is still there
+    std::vector<bool> kept(old_group_list.size(),false);
+    // labels that got built again, they may be ones that moved as well
+    std::unordered_set<std::string> built;
+    size_t label_count = 0;
+    long long shift = 0;
+
+    size_t const_index = 0;
+    // blocks may set the same names, so if one changed they all run again
+    bool consts_changed = !reuse;
+    for(auto& i : chunks) {
+        if(consts_changed || i.kind != PreProcessChunk::CONST) continue;
+        consts_changed = const_index >= old_consts.size() || !same_text(i.begin,i.end,old_consts[const_index]->begin,old_consts[const_index]->end);
+        ++const_index;
+    }
+    consts_changed = consts_changed || const_index != old_consts.size();
+    const_index = 0;
+    if(consts_changed) erase_old_consts(0);
+    for(size_t g = 0; g < groups.size(); ++g) {
+        const auto& group = groups[g];
+        const PreProcessChunk& head = chunks[group.first];
+        const PreProcessChunk* old_group = nullptr;
+        if(head.kind == PreProcessChunk::LABEL) ++label_count;
+        if(reuse && head.kind == PreProcessChunk::LABEL) {
+            // labels mostly keep their order, so the old one is searched close to the last one found
+            size_t og = old_group_list.size();
+            for(long long d = 0; d <= 16 && og == old_group_list.size(); ++d) {
+                for(long long k : {(long long)g + shift + d,(long long)g + shift - d}) {
+                    if(k < 0 || k >= (long long)old_group_list.size() || kept[k]) continue;
+                    const PreProcessChunk& old_head = cache.chunks[old_group_list[k].first];
+                    if(old_head.kind != head.kind || old_head.name != head.name) continue;
+                    og = k;
+                    break;
                 }
             }
-            else if(inst == "pragma") {
-                line.erase(line.begin(),line.begin()+2);
-                if(line.size() == 0) {
-                    settings.error_msg = "line " + std::to_string(i+1) + ": pragma: no instruction";
-                    return {};
+            if(og < old_group_list.size()) {
+                kept[og] = true;
+                shift = (long long)og - (long long)g;
+                if(old_group_list[og].last - old_group_list[og].first == group.last - group.first &&
+                    same_text(group_begin(chunks,group),group_end(chunks,group),group_begin(cache.chunks,old_group_list[og]),group_end(cache.chunks,old_group_list[og])))
+                    old_group = &cache.chunks[old_group_list[og].first];
+            }
+        }
+        const bool reuse_label = old_group != nullptr;
+        if(reuse && !reuse_label && head.kind == PreProcessChunk::LABEL) {
+            state.labels.erase(head.name);
+            built.insert(head.name);
+        }
+
+        for(size_t c = group.first; c < group.last; ++c) {
+            PreProcessChunk& chunk = chunks[c];
+            const PreProcessChunk* old = reuse_label ? old_group + (c - group.first) : nullptr;
+
+            if(c == group.first && reuse_label) {
+                const long long delta = (long long)chunk.newlines - (long long)old->newlines;
+                if(delta != 0) {
+                    auto found = state.labels.find(chunk.name);
+                    if(found != state.labels.end()) shift_label_lines(found->second,delta);
                 }
-                if(line[0].str || settings.interpreter.script_preprocesses.count(line[0].src) == 0) {
-                    settings.error_msg = "line " + std::to_string(i+1) + ": pragma: unknown instruction";
-                    return {};
+                state.current_label = chunk.name;
+                chunk.lines = old->lines;
+                state.line_offset += chunk.lines;
+                continue;
+            }
+
+            bool evaluate = true;
+            if(chunk.kind == PreProcessChunk::CONST) {
+                if(!consts_changed) {
+                    evaluate = false;
+                    chunk.constants = old_consts[const_index]->constants;
                 }
-                auto proc = settings.interpreter.script_preprocesses[line[0].src];
-                line.erase(line.begin());
-                proc(line,lines,i,settings);
-                if(settings.error_msg != "") {
-                    settings.error_msg = "line " + std::to_string(i+1) + ": pragma: " + settings.error_msg;
-                    return {};
+                ++const_index;
+                if(!evaluate && reuse_label) {
+                    chunk.lines = old->lines;
+                    state.line_offset += chunk.lines;
+                    continue;
                 }
             }
-            else if(is_label_arglist(line[2].src) && !line[2].str) {
-                if(ret.count(line[1].src) != 0) {
-                    settings.error_msg = "line " + std::to_string(i+1) + ": can't open label twice: " + line[1].src;
-                    return {};
-                }
-                current_label = line[1].src;
-                ret[current_label].arglist = parse_label_arglist(line[2].src);
-                ret[current_label].line = line[1].line;
+            else if(chunk.kind == PreProcessChunk::BAKE && reuse_label) {
+                // unchanged, so everything in it got baked the last time already
+                chunk.lines = old->lines;
+                state.line_offset += chunk.lines;
+                continue;
             }
-            else {
-                settings.error_msg = "line " + std::to_string(i+1) + ": invalid pre processor instruction: no match for: " + inst;
-                return {};
+            else if(chunk.kind == PreProcessChunk::PRELUDE && reuse && same_text(chunk.begin,chunk.end,cache.chunks[0].begin,cache.chunks[0].end)) {
+                // unchanged as well, see above
+                chunk.lines = cache.chunks[0].lines;
+                state.line_offset += chunk.lines;
+                continue;
+            }
+            else if(chunk.kind == PreProcessChunk::PRAGMA && reuse_label) {
+                // pragmas always run again, see `Interpreter::local_pragmas`
+                chunk.instruction = old->instruction;
+                for(auto& i : chunk.instruction) i.line += (long long)chunk.newlines - (long long)old->newlines;
+                std::vector<lexed_kittens> lines = {chunk.instruction};
+                if(!pre_process_line(lines,0,state,settings)) return {};
+                chunk.lines = old->lines;
+                state.line_offset += chunk.lines;
+                continue;
+            }
+
+            if(chunk.kind == PreProcessChunk::CONST && evaluate) state.constants = &chunk.constants;
+            auto lines = lexed.empty() ? pre_process_lex_chunk(source,chunk,settings) : std::move(lexed[c]);
+            if(chunk.kind == PreProcessChunk::PRAGMA && !lines.empty()) chunk.instruction = lines[0];
+            for(size_t i = 0; i < lines.size(); ++i) {
+                // the first line is the instruction, the rest belongs to the current label
+                if(i == 0 && !evaluate) continue;
+                if(i != 0 && reuse_label) continue;
+                if(!pre_process_line(lines,i,state,settings)) return {};
             }
+            state.constants = nullptr;
+            chunk.lines = lines.size();
+            state.line_offset += chunk.lines;
         }
-        else {
-            for(auto j : line) ret[current_label].lines.push_back(j);
+
+        if(g == 0 && reuse) {
+            if(stray_lines(chunks,group) != 0) {
+                // lines in front of the first label belong to "main", wherever that is
+                erase_old_consts(0);
+                auto baked = std::move(cache.baked);
+                cache.clear();
+                cache.baked = std::move(baked);
+                settings.labels.clear();
+                return pre_process_incremental(std::move(source),settings,cache);
+            }
         }
     }
 
-    return ret;
+    if(reuse) {
+        // labels that got removed
+        for(size_t i = 0; i < old_group_list.size(); ++i) {
+            const PreProcessChunk& old_head = cache.chunks[old_group_list[i].first];
+            if(!kept[i] && old_head.kind == PreProcessChunk::LABEL && built.count(old_head.name) == 0) state.labels.erase(old_head.name);
+        }
+        // the old lines in front of the first label made a "main" the new source doesn't have
+        std::unordered_set<std::string_view> seen;
+        for(auto& g : groups) {
+            if(chunks[g.first].kind == PreProcessChunk::LABEL) seen.insert(chunks[g.first].name);
+        }
+        if(!old_group_list.empty() && stray_lines(cache.chunks,old_group_list[0]) != 0 && seen.count("main") == 0) state.labels.erase("main");
+
+        // a label that is there twice only got built once
+        if(seen.size() != label_count) {
+            seen.clear();
+            size_t line_offset = 0;
+            for(size_t g = 0; g < groups.size(); ++g) {
+                const PreProcessChunk& head = chunks[groups[g].first];
+                if(head.kind == PreProcessChunk::LABEL && !seen.insert(head.name).second) {
+                    settings.error_msg = "line " + std::to_string(line_offset + 1) + ": can't open label twice: " + head.name;
+                    return {};
+                }
+                for(size_t c = groups[g].first; c < groups[g].last; ++c) line_offset += chunks[c].lines;
+            }
+        }
+    }
+
+    cache.source = std::move(source);
+    cache.chunks = std::move(chunks);
+    cache.valid = true;
+    return std::move(state.labels);
 }
 
 } /* namespace carescript */
@@ -0,0 +1,195 @@
+#ifndef CARESCRIPT_PROGRAM_HPP
+#define CARESCRIPT_PROGRAM_HPP
+
+#include "carescript-parsing.hpp"
+
+#include <cstdint>
+#include <string_view>
+
+namespace carescript {
+
+// Compact storage for pre processed programs that stay resident without being run.
+// Every distinct token text is stored once in a `ScriptStringPool`, a token is
+// a 4 byte index into it and line numbers are kept as runs of tokens sharing a line.
+// Pools can be shared between programs, then common names are stored only once
+
+// append only set of strings, every string keeps its index forever.
+// `intern` and the unpacking of programs may run on several threads
+class ScriptStringPool {
+    std::string buffer;
+    // string i is buffer[starts[i],starts[i + 1])
+    std::vector<uint32_t> starts = {0};
+    // open addressing, index + 1 of the string or 0 for a free slot
+    std::vector<uint32_t> table;
+    mutable std::mutex mutex;
+
+    friend class ScriptProgram;
+
+    inline std::string_view _view(uint32_t index) const noexcept {
+        return std::string_view(buffer.data() + starts[index],starts[index + 1] - starts[index]);
+    }
+    inline void _insert(uint32_t index) noexcept {
+        const size_t mask = table.size() - 1;
+        size_t slot = std::hash<std::string_view>{}(_view(index)) & mask;
+        while(table[slot] != 0) slot = (slot + 1) & mask;
+        table[slot] = index + 1;
+    }
+public:
+    ScriptStringPool() {}
+    ScriptStringPool(const ScriptStringPool&) = delete;
+    ScriptStringPool& operator=(const ScriptStringPool&) = delete;
+
+    // index of `str`, added if it isn't in the pool yet
+    inline uint32_t intern(std::string_view str) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(table.empty()) table.resize(64);
+        const size_t mask = table.size() - 1;
+        size_t slot = std::hash<std::string_view>{}(str) & mask;
+        while(table[slot] != 0) {
+            if(_view(table[slot] - 1) == str) return table[slot] - 1;
+            slot = (slot + 1) & mask;
+        }
+
+        const uint32_t index = starts.size() - 1;
+        buffer.append(str);
+        starts.push_back(buffer.size());
+        table[slot] = index + 1;
+        // at most half full
+        if((index + 1) * 2 > table.size()) {
+            table.assign(table.size() * 2,0);
+            for(uint32_t i = 0; i <= index; ++i) _insert(i);
+        }
+        return index;
+    }
+
+    inline std::string get(uint32_t index) const noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::string(_view(index));
+    }
+
+    inline size_t size() const noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        return starts.size() - 1;
+    }
+
+    inline size_t memory_usage() const noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        return sizeof(ScriptStringPool) + buffer.capacity() + starts.capacity() * sizeof(uint32_t) + table.capacity() * sizeof(uint32_t);
+    }
+};
+
+// the labels and constants of a pre processed program in compact form.
+// Pack it after `Interpreter::pre_process` and hand it to `Interpreter::load`
+// whenever it should run. Baked extensions aren't part of the program,
+// the labels marked with `@pragma memoize` are
+class ScriptProgram {
+    struct _internalLabel {
+        uint32_t name = 0;
+        std::vector<uint32_t> arglist;
+        int line = 0;
+        // tokens[begin,end) and runs[first_run,...) are the lines of the label
+        uint32_t begin = 0;
+        uint32_t end = 0;
+        uint32_t first_run = 0;
+    };
+    // `count` tokens in a row are on `line`
+    struct _internalRun {
+        uint32_t line = 0;
+        uint32_t count = 0;
+    };
+
+    std::shared_ptr<ScriptStringPool> strings;
+    std::vector<_internalLabel> label_list;
+    // string index << 1, the lowest bit is set for string literals
+    std::vector<uint32_t> tokens;
+    std::vector<_internalRun> runs;
+    std::map<std::string,ScriptVariable> constant_list;
+    // the memoized labels, without results
+    ScriptMemo memo;
+
+    inline ScriptLabel _unpack(const _internalLabel& label) const noexcept {
+        ScriptLabel ret;
+        ret.line = label.line;
+        ret.arglist.reserve(label.arglist.size());
+        for(auto i : label.arglist) ret.arglist.emplace_back(strings->_view(i));
+
+        ret.lines.resize(label.end - label.begin);
+        size_t run = label.first_run;
+        uint32_t left = label.begin == label.end ? 0 : runs[run].count;
+        for(uint32_t i = label.begin; i < label.end; ++i) {
+            if(left == 0) left = runs[++run].count;
+            --left;
+            KittenToken& token = ret.lines[i - label.begin];
+            token.src = strings->_view(tokens[i] >> 1);
+            token.str = tokens[i] & 1;
+            token.line = runs[run].line;
+        }
+        return ret;
+    }
+public:
+    ScriptProgram() {}
+    // packs `settings.labels`, `settings.constants` and the memoized labels of the interpreter
+    ScriptProgram(const ScriptSettings& settings, std::shared_ptr<ScriptStringPool> pool = nullptr) noexcept:
+        strings(pool == nullptr ? std::make_shared<ScriptStringPool>() : std::move(pool)),
+        constant_list(settings.constants), memo(settings.interpreter.memo) {
+        label_list.reserve(settings.labels.size());
+        for(auto& [name,label] : settings.labels) {
+            _internalLabel packed;
+            packed.name = strings->intern(name);
+            for(auto& i : label.arglist) packed.arglist.push_back(strings->intern(i));
+            packed.line = label.line;
+            packed.begin = tokens.size();
+            packed.first_run = runs.size();
+            for(auto& i : label.lines) {
+                tokens.push_back(strings->intern(i.src) << 1 | (i.str ? 1 : 0));
+                if(runs.size() == packed.first_run || runs.back().line != i.line) runs.push_back({(uint32_t)i.line,0});
+                ++runs.back().count;
+            }
+            packed.end = tokens.size();
+            label_list.push_back(std::move(packed));
+        }
+        tokens.shrink_to_fit();
+        runs.shrink_to_fit();
+    }
+
+    // the labels in the form the interpreter runs them
+    inline std::map<std::string,ScriptLabel> labels() const noexcept {
+        std::map<std::string,ScriptLabel> ret;
+        if(strings == nullptr) return ret;
+        std::lock_guard<std::mutex> lock(strings->mutex);
+        for(auto& i : label_list) {
+            ret.emplace_hint(ret.end(),strings->_view(i.name),_unpack(i));
+        }
+        return ret;
+    }
+    inline const std::map<std::string,ScriptVariable>& constants() const noexcept { return constant_list; }
+    inline const ScriptMemo& memoized() const noexcept { return memo; }
+    inline const std::shared_ptr<ScriptStringPool>& pool() const noexcept { return strings; }
+
+    // bytes used by the program, without its (possibly shared) pool
+    inline size_t memory_usage() const noexcept {
+        size_t ret = sizeof(ScriptProgram) + tokens.capacity() * sizeof(uint32_t) + runs.capacity() * sizeof(_internalRun);
+        ret += label_list.capacity() * sizeof(_internalLabel);
+        for(auto& i : label_list) ret += i.arglist.capacity() * sizeof(uint32_t);
+        for(auto& [name,value] : constant_list) ret += name.size() + value.memory_usage();
+        return ret;
+    }
+};
+
+inline InterpreterError Interpreter::load(const ScriptProgram& program) noexcept {
+    settings.error_msg = "";
+    preprocess_cache.clear();
+    // results of labels with the same name may be wrong for the program
+    memo = program.memoized();
+    labels_changed();
+    settings.labels = program.labels();
+    for(auto& [name,value] : program.constants()) {
+        if(!settings.set_constant(name,value)) break;
+    }
+    error_check();
+    return *this;
+}
+
+} /* namespace carescript */
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef CARESCRIPT_THREADS_HPP
+#define CARESCRIPT_THREADS_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <chrono>
+
+namespace carescript {
+
+// a fixed number of worker threads running queued tasks
+class ScriptThreadPool {
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+
+    void work() noexcept {
+        while(true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock,[this]{ return stopping || !tasks.empty(); });
+                if(tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+public:
+    ScriptThreadPool(size_t threads = std::thread::hardware_concurrency()) noexcept {
+        // the calling thread helps out as well
+        if(threads > 0) --threads;
+        for(size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([this]{ work(); });
+        }
+    }
+    ScriptThreadPool(const ScriptThreadPool&) = delete;
+    ScriptThreadPool& operator=(const ScriptThreadPool&) = delete;
+
+    ~ScriptThreadPool() noexcept {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for(auto& i : workers) i.join();
+    }
+
+    // number of threads working on a `parallel_for`, including the caller
+    size_t size() const noexcept { return workers.size() + 1; }
+
+    void push(std::function<void()> task) noexcept {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wakeup.notify_one();
+    }
+
+    // calls fn(i) for every i in [0,count) and returns once all calls are done.
+    // Safe to use from inside a task, the caller works on the indices too.
+    // Every thread starts with a slice of the indices and takes them from the
+    // front, once it runs out it steals the back half of another thread's slice
+    template<typename Fn>
+    void parallel_for(size_t count, Fn&& fn) noexcept {
+        if(count == 0) return;
+        if(count == 1 || workers.empty()) {
+            for(size_t i = 0; i < count; ++i) fn(i);
+            return;
+        }
+        std::function<void(size_t)> call = fn;
+        for(size_t first = 0; first < count; first += _max_slice) {
+            _parallel_for(first,std::min(_max_slice,count - first),call);
+        }
+    }
+
+private:
+    // slices are packed into 64 bits, [begin,end) with begin in the upper half
+    static constexpr size_t _max_slice = 0xFFFFFFFFull;
+    struct alignas(64) _internalSlice {
+        std::atomic<uint64_t> range = 0;
+    };
+    struct _internalState {
+        std::unique_ptr<_internalSlice[]> slices;
+        size_t threads = 0;
+        std::atomic<size_t> joined = 0;
+        std::atomic<size_t> done = 0;
+        size_t first = 0;
+        size_t count = 0;
+        std::function<void(size_t)>* fn = nullptr;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    // takes the next index of its own slice or steals from another one
+    inline static void _work(_internalState& s) noexcept {
+        const size_t self = s.joined.fetch_add(1) % s.threads;
+        std::atomic<uint64_t>& own = s.slices[self].range;
+        size_t finished = 0;
+        while(true) {
+            uint64_t range = own.load();
+            uint64_t begin = range >> 32, end = range & _max_slice;
+            if(begin < end) {
+                if(!own.compare_exchange_weak(range,(begin + 1) << 32 | end)) continue;
+                (*s.fn)(s.first + begin);
+                ++finished;
+                continue;
+            }
+
+            // only the owner stores into an empty slice
+            bool stolen = false;
+            for(size_t k = 1; k < s.threads && !stolen; ++k) {
+                std::atomic<uint64_t>& victim = s.slices[(self + k) % s.threads].range;
+                range = victim.load();
+                while(true) {
+                    begin = range >> 32;
+                    end = range & _max_slice;
+                    if(begin >= end) break;
+                    const uint64_t middle = end - (end - begin + 1) / 2;
+                    if(victim.compare_exchange_weak(range,begin << 32 | middle)) {
+                        own.store(middle << 32 | end);
+                        stolen = true;
+                        break;
+                    }
+                }
+            }
+            if(!stolen) break;
+        }
+        if(finished != 0 && s.done.fetch_add(finished) + finished == s.count) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.finished.notify_all();
+        }
+    }
+
+    inline void _parallel_for(size_t first, size_t count, std::function<void(size_t)>& fn) noexcept {
+        auto state = std::make_shared<_internalState>();
+        state->threads = std::min(workers.size() + 1,count);
+        state->slices = std::make_unique<_internalSlice[]>(state->threads);
+        for(size_t i = 0; i < state->threads; ++i) {
+            const uint64_t begin = count * i / state->threads;
+            const uint64_t end = count * (i + 1) / state->threads;
+            state->slices[i].range = begin << 32 | end;
+        }
+        state->first = first;
+        state->count = count;
+        state->fn = &fn;
+
+        // helpers that start after all indices are taken never touch `fn`
+        for(size_t i = 1; i < state->threads; ++i) {
+            push([state]{ _work(*state); });
+        }
+        _work(*state);
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock,[&]{ return state->done.load() == count; });
+    }
+};
+
+// blocks until `ready` returns true. It yields a few times first, then sleeps
+// a little longer after every try (up to a millisecond)
+inline static void script_wait_until(const std::function<bool()>& ready) noexcept {
+    std::chrono::microseconds pause(1);
+    for(size_t i = 0; !ready(); ++i) {
+        if(i < 64) {
+            std::this_thread::yield();
+            continue;
+        }
+        std::this_thread::sleep_for(pause);
+        pause = std::min(pause * 2,std::chrono::microseconds(1000));
+    }
+}
+
+// pool shared by every interpreter of the process
+inline ScriptThreadPool& script_thread_pool() noexcept {
+    static ScriptThreadPool pool;
+    return pool;
+}
+
+} /* namespace carescript */
+
+#endif
@@ -3,18 +3,143 @@
 
 #include <string>
 #include <vector>
+#include <string_view>
+#include <utility>
+#include <charconv>
+#include <system_error>
+#include <cmath>
+#include <limits>
+#include <functional>
+#include <type_traits>
 
 namespace carescript {
 
+// FNV-1a hash of a type name, used to compare types as integers
+constexpr size_t script_type_hash(std::string_view name) noexcept {
+    size_t hash = 14695981039346656037ull;
+    for(char c : name) {
+        hash ^= (unsigned char)c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// mixes `value` into `seed`, for hashes of values made of several parts
+constexpr size_t script_hash_combine(size_t seed, size_t value) noexcept {
+    return seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2));
+}
+
+// integral values that fit into a long long, these are printed as integers
+inline static bool _script_is_integral(long double number) noexcept {
+    return number > -9.2e18L && number < 9.2e18L && number == (long double)(long long)number;
+}
+
+// `number` with six decimals and the trailing zeros cut off (unless `pad` is set,
+// that's `std::to_string` then), rounded like printf does. Works on the exact binary
+// value with 128 bit integers, returns nullptr if the number doesn't fit (the caller
+// falls back to the slower formatting then)
+inline static char* _script_format_fixed6(char* buffer, size_t size, long double number, bool pad = false) noexcept {
+#ifdef __SIZEOF_INT128__
+    if constexpr(std::numeric_limits<long double>::digits <= 64) {
+        if(size < 32 || !(number > -9.2e18L && number < 9.2e18L)) return nullptr;
+        int exponent = 0;
+        const unsigned long long mantissa = (unsigned long long)std::ldexp(std::frexp(std::fabs(number),&exponent),64);
+        // |number| < 2^63, so at least one bit gets shifted out
+        const int shift = 64 - exponent;
+        unsigned __int128 scaled = 0;
+        if(shift < 128) {
+            const unsigned __int128 exact = (unsigned __int128)mantissa * 1000000u;
+            const unsigned __int128 rest = exact & (((unsigned __int128)1 << shift) - 1);
+            const unsigned __int128 half = (unsigned __int128)1 << (shift - 1);
+            scaled = exact >> shift;
+            if(rest > half || (rest == half && (scaled & 1))) ++scaled;
+        }
+        char* p = buffer;
+        if(std::signbit(number)) *p++ = '-';
+        p = std::to_chars(p,buffer + size,(unsigned long long)(scaled / 1000000u)).ptr;
+        unsigned decimals = (unsigned)(scaled % 1000000u);
+        if(decimals == 0 && !pad) return p;
+        *p++ = '.';
+        for(unsigned div = 100000; div != 0 && (decimals != 0 || pad); div /= 10) {
+            *p++ = '0' + decimals / div;
+            decimals %= div;
+        }
+        return p;
+    }
+#endif
+    return nullptr;
+}
+
+// parses a number like `std::stold` does (leading whitespace, a sign, hex with 0x),
+// but without locale, exceptions or copies. Unless `partial` is set the whole
+// input has to be a number. Returns the number of characters read, 0 on failure
+inline static size_t script_parse_number(std::string_view src, long double& number, bool partial = false) noexcept {
+    const char* begin = src.data();
+    const char* end = begin + src.size();
+    const char* p = begin;
+    while(p != end && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) ++p;
+    bool negative = false;
+    if(p != end && (*p == '+' || *p == '-')) negative = *p++ == '-';
+    if(p == end || *p == '+' || *p == '-') return 0;
+    std::chars_format format = std::chars_format::general;
+    if(end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        format = std::chars_format::hex;
+        p += 2;
+    }
+    else {
+        // plain decimals with up to 19 digits: the digits and the power of ten
+        // are exact, so one division rounds correctly (and is a lot faster)
+        unsigned long long digits = 0;
+        int count = 0;
+        int decimals = 0;
+        const char* q = p;
+        for(; q != end && *q >= '0' && *q <= '9'; ++q, ++count) digits = digits * 10 + (*q - '0');
+        if(q != end && *q == '.') {
+            for(++q; q != end && *q >= '0' && *q <= '9'; ++q, ++count, ++decimals) digits = digits * 10 + (*q - '0');
+        }
+        if(count != 0 && count <= 19 && (q == end || (partial && *q != 'e' && *q != 'E'))) {
+            long double scale = 1;
+            for(int i = 0; i < decimals; ++i) scale *= 10;
+            number = (long double)digits / scale;
+            if(negative) number = -number;
+            return q - begin;
+        }
+    }
+    auto [last, ec] = std::from_chars(p,end,number,format);
+    if(ec != std::errc() || (!partial && last != end)) return 0;
+    if(negative) number = -number;
+    return last - begin;
+}
+
+// writes the shortest text that parses back to `number`, returns the end
+// of the written characters or nullptr if `size` is too small
+inline static char* script_format_number(char* buffer, size_t size, long double number) noexcept {
+    if(_script_is_integral(number) && !(number == 0 && std::signbit(number))) {
+        auto [last, ec] = std::to_chars(buffer,buffer + size,(long long)number);
+        return ec == std::errc() ? last : nullptr;
+    }
+    auto [last, ec] = std::to_chars(buffer,buffer + size,number);
+    return ec == std::errc() ? last : nullptr;
+}
+
 // abstract class to provide an interface for all types
 struct ScriptValue {
     using type = void;
     virtual const std::string get_type() const noexcept= 0;
+    // `script_type_hash(get_type())`, override it with a constant if you
+    // can (subclasses that change `get_type()` have to override it as well)
+    virtual size_t type_id() const noexcept { return script_type_hash(get_type()); }
     virtual bool operator==(const ScriptValue*) const noexcept = 0;
     virtual bool operator==(const ScriptValue&v) const noexcept { return operator==(&v); }
     virtual std::string to_printable() const noexcept = 0;
     virtual std::string to_string() const noexcept = 0;
     virtual ScriptValue* copy() const noexcept = 0;
+    // bytes held by this value, used for the memory limit of an interpreter.
+    // Override it for types that own memory (include `sizeof` of the type)
+    virtual size_t memory_usage() const noexcept { return sizeof(ScriptValue); }
+    // values that are == need the same hash, used to look up memoized results.
+    // Override it if `to_printable` is slow or doesn't tell values apart
+    virtual size_t hash() const noexcept { return script_hash_combine(type_id(),std::hash<std::string>{}(to_printable())); }
     void get_value() const noexcept {}
     void get_value() noexcept {}
 
@@ -24,13 +149,30 @@ struct ScriptValue {
 // default number type implementation
 struct ScriptNumberValue : public ScriptValue {
     const std::string get_type() const noexcept override { return "Number"; }
+    static constexpr size_t static_type_id = script_type_hash("Number");
+    size_t type_id() const noexcept override { return static_type_id; }
     long double number = 0.0;
+    // the same value as `number` if `is_integer` is set, the default operators
+    // use it to do exact integer math instead of floating point math
+    long long integer = 0;
+    bool is_integer = false;
 
     bool operator==(const ScriptValue* val) const noexcept override {
-        return val->get_type() == get_type() && ((ScriptNumberValue*)val)->number == number;
+        return val->type_id() == static_type_id && ((ScriptNumberValue*)val)->number == number;
     }
 
+    // six decimals like `std::to_string`, trailing zeros cut off
     std::string to_printable() const noexcept override {
+        char buffer[64];
+        if(is_integer) {
+            return std::string(buffer,std::to_chars(buffer,buffer + sizeof(buffer),integer).ptr);
+        }
+        if(_script_is_integral(number) && !(number == 0 && std::signbit(number))) {
+            return std::string(buffer,std::to_chars(buffer,buffer + sizeof(buffer),(long long)number).ptr);
+        }
+        if(char* last = _script_format_fixed6(buffer,sizeof(buffer),number)) {
+            return std::string(buffer,last);
+        }
         std::string str = std::to_string(number);
         str.erase(str.find_last_not_of('0') + 1, std::string::npos);
         str.erase(str.find_last_not_of('.') + 1, std::string::npos);
@@ -41,22 +183,55 @@ struct ScriptNumberValue : public ScriptValue {
     }
 
     long double get_value() const noexcept { return number; }
-    long double& get_value() noexcept { return number; }
-    ScriptValue* copy() const noexcept override { return new ScriptNumberValue(number); }
+    // the number may get changed through the reference, so `integer` is dropped
+    long double& get_value() noexcept { is_integer = false; return number; }
+    size_t memory_usage() const noexcept override { return sizeof(ScriptNumberValue); }
+    size_t hash() const noexcept override {
+        if(is_integer) return std::hash<long long>{}(integer);
+        if(_script_is_integral(number)) return std::hash<long long>{}((long long)number);
+        return std::hash<long double>{}(number);
+    }
+    ScriptValue* copy() const noexcept override {
+        ScriptNumberValue* ret = new ScriptNumberValue(number);
+        ret->integer = integer;
+        ret->is_integer = is_integer;
+        return ret;
+    }
 
     ScriptNumberValue() {}
     ScriptNumberValue(long double num): number(num) {}
 
+    // a number that takes the integer fast path of the default operators
+    static ScriptNumberValue* from_integer(long long num) noexcept {
+        ScriptNumberValue* ret = new ScriptNumberValue((long double)num);
+        ret->integer = num;
+        ret->is_integer = true;
+        return ret;
+    }
+
     operator long double() const noexcept { return get_value(); }
 };
 
+// integral values take the integer fast path (see `ScriptNumberValue::from_integer`)
+template<typename Tp> requires std::is_arithmetic_v<Tp>
+inline static ScriptNumberValue* script_number(Tp number) noexcept {
+    if constexpr(std::is_integral_v<Tp>) {
+        if(std::is_signed_v<Tp> || (unsigned long long)number <= (unsigned long long)std::numeric_limits<long long>::max()) {
+            return ScriptNumberValue::from_integer((long long)number);
+        }
+    }
+    return new ScriptNumberValue((long double)number);
+}
+
 // default string type implementation
 struct ScriptStringValue : public ScriptValue {
     const std::string get_type() const noexcept override { return "String"; }
+    static constexpr size_t static_type_id = script_type_hash("String");
+    size_t type_id() const noexcept override { return static_type_id; }
     std::string string = "";
     
     bool operator==(const ScriptValue* val) const noexcept override {
-        return val->get_type() == get_type() && ((ScriptStringValue*)val)->string == string;
+        return val->type_id() == static_type_id && ((ScriptStringValue*)val)->string == string;
     }
 
     std::string to_printable() const noexcept override {
@@ -69,9 +244,11 @@ struct ScriptStringValue : public ScriptValue {
     std::string get_value() const noexcept { return string; }
     std::string& get_value() noexcept { return string; }
     ScriptValue* copy() const noexcept override { return new ScriptStringValue(string); }
+    size_t memory_usage() const noexcept override { return sizeof(ScriptStringValue) + string.size(); }
+    size_t hash() const noexcept override { return script_hash_combine(static_type_id,std::hash<std::string>{}(string)); }
 
     ScriptStringValue() {}
-    ScriptStringValue(std::string str): string(str) {}
+    ScriptStringValue(std::string str): string(std::move(str)) {}
 
     operator std::string() const noexcept { return get_value(); }
 };
@@ -79,10 +256,12 @@ struct ScriptStringValue : public ScriptValue {
 // default name type implementation
 struct ScriptNameValue : public ScriptValue {
     const std::string get_type() const noexcept override { return "Name"; }
+    static constexpr size_t static_type_id = script_type_hash("Name");
+    size_t type_id() const noexcept override { return static_type_id; }
     std::string name = "";
     
     bool operator==(const ScriptValue* val) const noexcept override {
-        return val->get_type() == get_type() && ((ScriptNameValue*)val)->name == name;
+        return val->type_id() == static_type_id && ((ScriptNameValue*)val)->name == name;
     }
 
     std::string to_printable() const noexcept override {
@@ -95,6 +274,8 @@ struct ScriptNameValue : public ScriptValue {
     std::string get_value() const noexcept { return name; }
     std::string& get_value() noexcept { return name; }
     ScriptValue* copy() const noexcept override { return new ScriptNameValue(name); }
+    size_t memory_usage() const noexcept override { return sizeof(ScriptNameValue) + name.size(); }
+    size_t hash() const noexcept override { return script_hash_combine(static_type_id,std::hash<std::string>{}(name)); }
 
     ScriptNameValue() {}
     ScriptNameValue(std::string name): name(name) {}
@@ -103,9 +284,11 @@ struct ScriptNameValue : public ScriptValue {
 // default null type implementation
 struct ScriptNullValue : public ScriptValue {
     const std::string get_type() const noexcept override { return "Null"; }
+    static constexpr size_t static_type_id = script_type_hash("Null");
+    size_t type_id() const noexcept override { return static_type_id; }
     
     bool operator==(const ScriptValue* val) const noexcept override {
-        return val->get_type() == get_type();
+        return val->type_id() == static_type_id;
     }
 
     std::string to_printable() const noexcept override {
@@ -117,6 +300,8 @@ struct ScriptNullValue : public ScriptValue {
 
     void get_value() const noexcept { return; }
     ScriptValue* copy() const noexcept override { return new ScriptNullValue(); }
+    size_t memory_usage() const noexcept override { return sizeof(ScriptNullValue); }
+    size_t hash() const noexcept override { return static_type_id; }
 
     ScriptNullValue() {}
 };
@@ -14,6 +14,8 @@ public:
 
     val_t get_value() const { return list; }
     const std::string get_type() const noexcept override { return "List"; }
+    static constexpr size_t static_type_id = script_type_hash("List");
+    size_t type_id() const noexcept override { return static_type_id; }
     bool operator==(const ScriptValue* p) const noexcept{
         return p->get_type() == get_type() && ((ListType*)p)->get_value() == get_value();
     };
@@ -31,21 +33,308 @@ public:
     ScriptValue* copy() const noexcept {
         return new ListType(list);
     }
+    size_t memory_usage() const noexcept override {
+        size_t bytes = sizeof(ListType) + list.size() * sizeof(ScriptVariable);
+        for(auto& i : list) bytes += i.memory_usage();
+        return bytes;
+    }
+    size_t hash() const noexcept override {
+        size_t ret = static_type_id;
+        for(auto& i : list) ret = script_hash_combine(ret,i.hash());
+        return ret;
+    }
 
     ListType() {}
     ListType(val_t v) : list(v) {}
     
 };
 
+// a list of numbers only, stored contiguously so the kernels below
+// walk plain memory instead of chasing a pointer per element
+class NumberListType : public ScriptValue {
+public:
+    using val_t = std::vector<double>;
+    val_t list;
+
+    static constexpr size_t static_type_id = script_type_hash("NumberList");
+    size_t type_id() const noexcept override { return static_type_id; }
+    const std::string get_type() const noexcept override { return "NumberList"; }
+
+    const val_t& get_value() const noexcept { return list; }
+    val_t& get_value() noexcept { return list; }
+    bool operator==(const ScriptValue* p) const noexcept override {
+        return p->type_id() == static_type_id && ((NumberListType*)p)->list == list;
+    };
+    std::string to_printable() const noexcept override {
+        std::string s = "[";
+        for(auto i : list) {
+            s += ScriptNumberValue(i).to_printable() + ",";
+        }
+        if(s != "[") s.pop_back();
+        return s + "]";
+    }
+    std::string to_string() const noexcept override {
+        return to_printable();
+    }
+    ScriptValue* copy() const noexcept override {
+        return new NumberListType(list);
+    }
+    size_t memory_usage() const noexcept override {
+        return sizeof(NumberListType) + list.size() * sizeof(double);
+    }
+    size_t hash() const noexcept override {
+        size_t ret = static_type_id;
+        for(double i : list) ret = script_hash_combine(ret,std::hash<double>{}(i));
+        return ret;
+    }
+
+    NumberListType() {}
+    NumberListType(val_t v) : list(std::move(v)) {}
+};
+
+// the stored vector, without copying it like get_value<NumberListType> would
+inline static const NumberListType::val_t& packed(const ScriptVariable& var) noexcept {
+    return ((const NumberListType*)var.value.get())->list;
+}
+
+// a generic copy of either list type
+inline static ListType::val_t to_list(const ScriptVariable& var) noexcept {
+    if(is_typeof<ListType>(var)) return get_value<ListType>(var);
+    ListType::val_t ret;
+    ret.reserve(packed(var).size());
+    for(auto i : packed(var)) ret.push_back(new ScriptNumberValue(i));
+    return ret;
+}
+
+// packs a generic list, returns false if it holds anything but numbers.
+// Numbers are long doubles and get narrowed to double here, so digits past
+// the 15th or so and integers above 2^53 don't survive packing
+inline static bool pack_list(const ListType::val_t& list, NumberListType::val_t& out) noexcept {
+    out.resize(list.size());
+    for(size_t i = 0; i < list.size(); ++i) {
+        if(!is_typeof<ScriptNumberValue>(list[i])) return false;
+        out[i] = (double)get_value<ScriptNumberValue>(list[i]);
+    }
+    return true;
+}
+
+// the numbers of a NumberList, or of a List holding nothing but numbers (packed into
+// `storage`). Null for any other value
+inline static const NumberListType::val_t* numbers_of(const ScriptVariable& var, NumberListType::val_t& storage) noexcept {
+    if(is_typeof<NumberListType>(var)) return &packed(var);
+    if(is_typeof<ListType>(var) && pack_list(((const ListType*)var.value.get())->list,storage)) return &storage;
+    return nullptr;
+}
+
+// a List is a NumberList if it packs into the same numbers, compared after
+// the narrowing so `[0.1] is pack([0.1])` holds
+inline static bool mixed_equal(const ScriptVariable& left, const ScriptVariable& right) noexcept {
+    const bool list_left = is_typeof<ListType>(left);
+    const ListType::val_t& list = ((const ListType*)(list_left ? left : right).value.get())->list;
+    NumberListType::val_t storage;
+    return pack_list(list,storage) && storage == packed(list_left ? right : left);
+}
+
+// runs the binary operator `name` of the interpreter on two elements, like an expression would
+inline static ScriptVariable element_run(const std::string& name, const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings) noexcept {
+    auto found = settings.interpreter.script_operators.find(name);
+    _cc_error_if(found == settings.interpreter.script_operators.end(),"unknown operator: " + name);
+    _expressionToken token;
+    token.tk = name;
+    token.overloads = &found->second;
+    for(auto& i : found->second) {
+        if(i.type != ScriptOperator::BINARY) continue;
+        if(token.candidates == 0) token.op = i;
+        if(i.priority == token.op.priority) ++token.candidates;
+    }
+    _cc_error_if(token.candidates == 0,"no binary operator: " + name);
+    _expressionErrors errors;
+    ScriptVariable ret = expression_run_operator(token,left,right,settings,errors);
+    if(errors.changed()) {
+        settings.error_msg = "";
+        for(auto& i : errors.messages) settings.error_msg += (settings.error_msg == "" ? "" : "\n") + i;
+        return script_null;
+    }
+    return ret;
+}
+
+// the kernels are plain loops over restrict pointers, reductions keep four
+// independent accumulators so the compiler can turn them into vector code
+template<typename Op>
+inline static void packed_apply(const double* __restrict a, const double* __restrict b, double* __restrict out, size_t n, Op op) noexcept {
+    for(size_t i = 0; i < n; ++i) out[i] = op(a[i],b[i]);
+}
+template<typename Op>
+inline static void packed_apply_left(double a, const double* __restrict b, double* __restrict out, size_t n, Op op) noexcept {
+    for(size_t i = 0; i < n; ++i) out[i] = op(a,b[i]);
+}
+template<typename Op>
+inline static void packed_apply_right(const double* __restrict a, double b, double* __restrict out, size_t n, Op op) noexcept {
+    for(size_t i = 0; i < n; ++i) out[i] = op(a[i],b);
+}
+
+inline static double packed_sum(const double* __restrict a, size_t n) noexcept {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4) {
+        s0 += a[i]; s1 += a[i+1]; s2 += a[i+2]; s3 += a[i+3];
+    }
+    for(; i < n; ++i) s0 += a[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+inline static double packed_dot(const double* __restrict a, const double* __restrict b, size_t n) noexcept {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i]; s1 += a[i+1] * b[i+1];
+        s2 += a[i+2] * b[i+2]; s3 += a[i+3] * b[i+3];
+    }
+    for(; i < n; ++i) s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+// n must not be 0
+template<typename Pick>
+inline static double packed_reduce(const double* __restrict a, size_t n, Pick pick) noexcept {
+    double m0 = a[0], m1 = a[0], m2 = a[0], m3 = a[0];
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4) {
+        m0 = pick(m0,a[i]); m1 = pick(m1,a[i+1]);
+        m2 = pick(m2,a[i+2]); m3 = pick(m3,a[i+3]);
+    }
+    for(; i < n; ++i) m0 = pick(m0,a[i]);
+    return pick(pick(m0,m1),pick(m2,m3));
+}
+
+// the element-wise operators, elements of lists that aren't all numbers go through `name`
+struct PackedAdd {
+    static constexpr const char* name = "+";
+    double operator()(double a, double b) const noexcept { return a + b; }
+};
+struct PackedSub {
+    static constexpr const char* name = "-";
+    double operator()(double a, double b) const noexcept { return a - b; }
+};
+struct PackedMul {
+    static constexpr const char* name = "*";
+    double operator()(double a, double b) const noexcept { return a * b; }
+};
+struct PackedDiv {
+    static constexpr const char* name = "/";
+    double operator()(double a, double b) const noexcept { return a / b; }
+};
+// comparisons give 1 and 0
+struct PackedMore {
+    static constexpr const char* name = "more";
+    double operator()(double a, double b) const noexcept { return a > b ? 1.0 : 0.0; }
+};
+struct PackedLess {
+    static constexpr const char* name = "less";
+    double operator()(double a, double b) const noexcept { return a < b ? 1.0 : 0.0; }
+};
+
+// `Op::name` for every element, with a List of anything on one or both sides
+template<typename Op>
+inline static ScriptVariable element_loop(const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings) noexcept {
+    const bool llist = is_typeof<ListType>(left) || is_typeof<NumberListType>(left);
+    const bool rlist = is_typeof<ListType>(right) || is_typeof<NumberListType>(right);
+    const ListType::val_t l = llist ? to_list(left) : ListType::val_t{};
+    const ListType::val_t r = rlist ? to_list(right) : ListType::val_t{};
+    _cc_error_if(llist && rlist && l.size() != r.size(),"size mismatch (left: " + std::to_string(l.size()) + " | right: " + std::to_string(r.size()) + ")");
+    const size_t size = llist ? l.size() : r.size();
+    ListType::val_t ret;
+    ret.reserve(size);
+    for(size_t i = 0; i < size; ++i) {
+        ret.push_back(element_run(Op::name,llist ? l[i] : left,rlist ? r[i] : right,settings));
+        if(settings.error_msg != "") return script_null;
+    }
+    return new ListType(std::move(ret));
+}
+
+// an element-wise operator for lists of the same size and lists with a Number on
+// either side. Lists of numbers (packed or not) run the kernels, others `element_loop`
+template<typename Op>
+inline static ScriptVariable packed_run(const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings) noexcept {
+    const Op op{};
+    NumberListType::val_t lstorage, rstorage;
+    const NumberListType::val_t* l = numbers_of(left,lstorage);
+    const NumberListType::val_t* r = numbers_of(right,rstorage);
+    const bool lnumber = is_typeof<ScriptNumberValue>(left);
+    const bool rnumber = is_typeof<ScriptNumberValue>(right);
+    if((l == nullptr && !lnumber) || (r == nullptr && !rnumber)) return element_loop<Op>(left,right,settings);
+
+    // like the scalar operator
+    if constexpr(std::is_same_v<Op,PackedDiv>) {
+        bool zero = rnumber ? get_value<ScriptNumberValue>(right) == 0 : false;
+        for(size_t i = 0; r != nullptr && i < r->size() && !zero; ++i) zero = (*r)[i] == 0;
+        _cc_error_if(zero,"/: division through 0 is not allowed");
+    }
+    NumberListType* ret = nullptr;
+    if(l != nullptr && r != nullptr) {
+        _cc_error_if(l->size() != r->size(),"size mismatch (left: " + std::to_string(l->size()) + " | right: " + std::to_string(r->size()) + ")");
+        ret = new NumberListType(NumberListType::val_t(l->size()));
+        packed_apply(l->data(),r->data(),ret->list.data(),l->size(),op);
+    }
+    else if(l != nullptr) {
+        ret = new NumberListType(NumberListType::val_t(l->size()));
+        packed_apply_right(l->data(),(double)get_value<ScriptNumberValue>(right),ret->list.data(),l->size(),op);
+    }
+    else {
+        ret = new NumberListType(NumberListType::val_t(r->size()));
+        packed_apply_left((double)get_value<ScriptNumberValue>(left),r->data(),ret->list.data(),r->size(),op);
+    }
+    return ret;
+}
+// one overload per pair of operand types it takes, so the interpreter never calls it with
+// others. List with List is left out for `+`, which joins two Lists
+template<typename Op>
+inline static std::vector<ScriptOperator> packed_operators(int priority) noexcept {
+    constexpr size_t packed_list = NumberListType::static_type_id;
+    constexpr size_t list = ListType::static_type_id;
+    constexpr size_t number = ScriptNumberValue::static_type_id;
+    std::vector<ScriptOperator> ret = {
+        {priority,ScriptOperator::BINARY,packed_run<Op>,packed_list,packed_list},
+        {priority,ScriptOperator::BINARY,packed_run<Op>,packed_list,number},
+        {priority,ScriptOperator::BINARY,packed_run<Op>,number,packed_list},
+        {priority,ScriptOperator::BINARY,packed_run<Op>,packed_list,list},
+        {priority,ScriptOperator::BINARY,packed_run<Op>,list,packed_list},
+        {priority,ScriptOperator::BINARY,packed_run<Op>,list,number},
+        {priority,ScriptOperator::BINARY,packed_run<Op>,number,list},
+    };
+    if constexpr(!std::is_same_v<Op,PackedAdd>) ret.push_back({priority,ScriptOperator::BINARY,packed_run<Op>,list,list});
+    return ret;
+}
+
+// the value `pick` keeps, with the interpreter's `compare` operator for lists that aren't all numbers
+inline static ScriptVariable element_pick(const ListType::val_t& list, const std::string& compare, ScriptSettings& settings) noexcept {
+    ScriptVariable best = list[0];
+    for(size_t i = 1; i < list.size(); ++i) {
+        ScriptVariable better = element_run(compare,list[i],best,settings);
+        if(settings.error_msg != "") return script_null;
+        _cc_error_if(!is_typeof<ScriptNumberValue>(better),compare + " didn't give a Number (got: " + better.get_type() + ")");
+        if(get_value<ScriptNumberValue>(better) != 0) best = list[i];
+    }
+    return best;
+}
+
 class ListExtention : public Extension {
 public:
     BuiltinList get_builtins() override {
         return {
             {"push",{-1,[](const ScriptArglist& args,ScriptSettings& settings)->ScriptVariable {
                 cc_builtin_if_ignore();
-                cc_builtin_var_requires(args[0],ListType);
                 cc_builtin_arg_min(args,2);
-                ListType list = get_value<ListType>(args[0]);
+                cc_builtin_var_requires(args[0],ListType,NumberListType);
+                if(is_typeof<NumberListType>(args[0])) {
+                    NumberListType::val_t list = packed(args[0]);
+                    size_t i = 1;
+                    for(; i < args.size() && is_typeof<ScriptNumberValue>(args[i]); ++i) {
+                        list.push_back((double)get_value<ScriptNumberValue>(args[i]));
+                    }
+                    if(i == args.size()) return new NumberListType(std::move(list));
+                }
+                ListType list = to_list(args[0]);
                 for(size_t i = 1; i < args.size(); ++i) {
                     list.list.push_back(args[i]);
                 }
@@ -53,31 +342,129 @@ public:
             }}},
             {"pop",{-1,[](const ScriptArglist& args,ScriptSettings& settings)->ScriptVariable {
                 cc_builtin_if_ignore();
-                cc_builtin_var_requires(args[0],ListType);
                 cc_builtin_arg_range(args,1,2);
+                cc_builtin_var_requires(args[0],ListType,NumberListType);
                 size_t count = 1;
                 if(args.size() == 2) {
                     cc_builtin_var_requires(args[1],ScriptNumberValue);
                     count = (size_t)get_value<ScriptNumberValue>(args[1]);
                 }
+                if(is_typeof<NumberListType>(args[0])) {
+                    NumberListType::val_t list = packed(args[0]);
+                    _cc_error_if(list.size() <= count,"popped not existing element (size below 0)");
+                    list.resize(list.size() - count);
+                    return new NumberListType(std::move(list));
+                }
                 ListType list = get_value<ListType>(args[0]);
                 _cc_error_if(list.list.size() <= count,"popped not existing element (size below 0)");
                 for(size_t i = 0; i < count; ++i) list.list.pop_back();
                 return new ListType(list);
-            }}}
+            }}},
+            // packs a list of numbers, any other list is returned as it is
+            {"pack",{-1,[](const ScriptArglist& args,ScriptSettings& settings)->ScriptVariable {
+                cc_builtin_if_ignore();
+                cc_builtin_arg_range(args,1,1);
+                cc_builtin_var_requires(args[0],ListType,NumberListType);
+                if(is_typeof<NumberListType>(args[0])) return args[0];
+                NumberListType::val_t list;
+                if(!pack_list(get_value<ListType>(args[0]),list)) return args[0];
+                return new NumberListType(std::move(list));
+            }}},
+            {"unpack",{-1,[](const ScriptArglist& args,ScriptSettings& settings)->ScriptVariable {
+                cc_builtin_if_ignore();
+                cc_builtin_arg_range(args,1,1);
+                cc_builtin_var_requires(args[0],ListType,NumberListType);
+                return new ListType(to_list(args[0]));
+            }}},
+            // the following take Lists and NumberLists, Lists of anything but numbers
+            // go through the operators of the interpreter one element at a time
+            {"sum",{-1,[](const ScriptArglist& args,ScriptSettings& settings)->ScriptVariable {
+                cc_builtin_if_ignore();
+                cc_builtin_arg_range(args,1,1);
+                cc_builtin_var_requires(args[0],ListType,NumberListType);
+                NumberListType::val_t storage;
+                if(auto list = numbers_of(args[0],storage)) return new ScriptNumberValue(packed_sum(list->data(),list->size()));
+                const ListType::val_t& list = ((const ListType*)args[0].value.get())->list;
+                ScriptVariable ret = list[0];
+                for(size_t i = 1; i < list.size() && settings.error_msg == ""; ++i) ret = element_run("+",ret,list[i],settings);
+                return ret;
+            }}},
+            {"min",{-1,[](const ScriptArglist& args,ScriptSettings& settings)->ScriptVariable {
+                cc_builtin_if_ignore();
+                cc_builtin_arg_range(args,1,1);
+                cc_builtin_var_requires(args[0],ListType,NumberListType);
+                NumberListType::val_t storage;
+                if(auto list = numbers_of(args[0],storage)) {
+                    _cc_error_if(list->empty(),"min of an empty list");
+                    return new ScriptNumberValue(packed_reduce(list->data(),list->size(),[](double a, double b) { return b < a ? b : a; }));
+                }
+                return element_pick(((const ListType*)args[0].value.get())->list,"less",settings);
+            }}},
+            {"max",{-1,[](const ScriptArglist& args,ScriptSettings& settings)->ScriptVariable {
+                cc_builtin_if_ignore();
+                cc_builtin_arg_range(args,1,1);
+                cc_builtin_var_requires(args[0],ListType,NumberListType);
+                NumberListType::val_t storage;
+                if(auto list = numbers_of(args[0],storage)) {
+                    _cc_error_if(list->empty(),"max of an empty list");
+                    return new ScriptNumberValue(packed_reduce(list->data(),list->size(),[](double a, double b) { return b > a ? b : a; }));
+                }
+                return element_pick(((const ListType*)args[0].value.get())->list,"more",settings);
+            }}},
+            {"dot",{-1,[](const ScriptArglist& args,ScriptSettings& settings)->ScriptVariable {
+                cc_builtin_if_ignore();
+                cc_builtin_arg_range(args,2,2);
+                cc_builtin_var_requires(args[0],ListType,NumberListType);
+                cc_builtin_var_requires(args[1],ListType,NumberListType);
+                NumberListType::val_t lstorage, rstorage;
+                auto l = numbers_of(args[0],lstorage);
+                auto r = numbers_of(args[1],rstorage);
+                if(l != nullptr && r != nullptr) {
+                    _cc_error_if(l->size() != r->size(),"size mismatch (left: " + std::to_string(l->size()) + " | right: " + std::to_string(r->size()) + ")");
+                    return new ScriptNumberValue(packed_dot(l->data(),r->data(),l->size()));
+                }
+                const ListType::val_t left = to_list(args[0]);
+                const ListType::val_t right = to_list(args[1]);
+                _cc_error_if(left.size() != right.size(),"size mismatch (left: " + std::to_string(left.size()) + " | right: " + std::to_string(right.size()) + ")");
+                ScriptVariable ret = script_null;
+                for(size_t i = 0; i < left.size() && settings.error_msg == ""; ++i) {
+                    ScriptVariable product = element_run("*",left[i],right[i],settings);
+                    if(settings.error_msg == "") ret = i == 0 ? product : element_run("+",ret,product,settings);
+                }
+                return ret;
+            }}},
         };
     }
 
     OperatorList get_operators() { 
+        auto plus = packed_operators<PackedAdd>(0);
+        plus.insert(plus.begin(),{0,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
+            cc_operator_same_type(right,left,"+");
+            cc_operator_var_requires(right,"+",ListType);
+            auto lvec = get_value<ListType>(left);
+            auto rvec = get_value<ListType>(right);
+            for(auto& i : rvec) lvec.push_back(i);
+            return new ListType(lvec);
+        },ListType::static_type_id,ListType::static_type_id});
+        constexpr size_t packed_list = NumberListType::static_type_id;
+        constexpr size_t list = ListType::static_type_id;
+        auto is = [](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
+            return _script_bool(mixed_equal(left,right));
+        };
+        auto isnt = [](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
+            return _script_bool(!mixed_equal(left,right));
+        };
         return {
-            {{"+",{{0,ScriptOperator::BINARY,[](const ScriptVariable& left, const ScriptVariable& right, ScriptSettings& settings)->ScriptVariable {
-                cc_operator_same_type(right,left,"+");
-                cc_operator_var_requires(right,"+",ListType);
-                auto lvec = get_value<ListType>(left);
-                auto rvec = get_value<ListType>(right);
-                for(auto& i : rvec) lvec.push_back(i);
-                return new ListType(lvec);
-            }}}}},
+            {"+",plus},
+            {"-",packed_operators<PackedSub>(0)},
+            {"*",packed_operators<PackedMul>(-1)},
+            {"/",packed_operators<PackedDiv>(-1)},
+            // element-wise comparisons give a NumberList of 1 and 0
+            {"more",packed_operators<PackedMore>(5)},
+            {"less",packed_operators<PackedLess>(5)},
+            // the two list types compare by their numbers
+            {"is",{{2,ScriptOperator::BINARY,is,list,packed_list},{2,ScriptOperator::BINARY,is,packed_list,list}}},
+            {"isnt",{{2,ScriptOperator::BINARY,isnt,list,packed_list},{2,ScriptOperator::BINARY,isnt,packed_list,list}}},
         }; 
     }
     TypeList get_types() { 
@@ -0,0 +1,36 @@
+#include "../carescript-api.hpp"
+#include "../carescript-aot.hpp"
+
+/*
+    This is a template for compiling a script
+    ahead of time into an extension:
+
+    ./aot script.cars compiled.cpp
+    g++ -std=c++20 -shared -fPIC compiled.cpp -o compiled.so
+
+    and then baking "compiled" after all other extensions
+*/
+
+int main(int argc, char** argv) {
+    using namespace carescript;
+    if(argc < 3) {
+        std::cout << "usage: " << argv[0] << " <script> <output.cpp> [extension id]\n";
+        return 1;
+    }
+
+    std::ifstream ifile(argv[1]);
+    std::string source((std::istreambuf_iterator<char>(ifile)),std::istreambuf_iterator<char>());
+
+    Interpreter interp;
+    interp.pre_process(source);
+    if(!interp) {
+        std::cout << interp.error() << "\n";
+        return 1;
+    }
+
+    ScriptAotOptions options;
+    if(argc > 3) options.id = argv[3];
+    std::ofstream ofile(argv[2]);
+    ofile << transpile(interp.settings,options);
+    return 0;
+}
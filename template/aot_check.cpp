@@ -0,0 +1,142 @@
+#include "../carescript-api.hpp"
+
+#include <cstdlib>
+
+/*
+    This is a template for checking that compiled labels
+    behave like interpreted ones. Every script runs interpreted
+    and again with its compiled extension baked, the output,
+    return value and error have to be the same:
+
+    ./aot_check ["g++ -std=c++20 -shared -fPIC"]
+*/
+
+struct Example {
+    std::string name;
+    std::string source;
+    std::string label = "main";
+    std::vector<carescript::ScriptVariable> args = {};
+};
+
+// the examples of the README and of template/usage.cpp
+const std::vector<Example> examples = {
+    {"layout",R"(
+@main[]
+    echoln("This is the main function")
+    set(a,45)
+    echoln($a + 4)
+    echoln(call(foo,5))
+
+@foo[a]
+    return($a * 2)
+)"},
+    {"parallel_call",R"(
+@main[]
+    parallel_call(a,foo,5,b,foo,6)
+    echoln($a + $b)
+
+@foo[a]
+    return($a * 2)
+)"},
+    {"usage",R"(
+@const[
+    the_answer = 12
+]
+
+@add[x,y]
+    return($x + $y)
+
+@mul[x,y]
+    if($y is 1 or $y is 0)
+        return($x)
+    endif()
+    if($y is 0)
+        return(0)
+    endif()
+
+    return(call(mul,$x,$y - 1) + $x)
+
+@main[]
+    echoln("Hello, World!")
+    echoln(call(mul,9,8), " ", call(add,5,213), " ", $the_answer)
+    echoln(-($the_answer - 2) * 3 more 0 and not 0)
+    echoln(1 / 0)
+)"},
+    {"mul",R"(
+@mul[x,y]
+    if($y is 1 or $y is 0)
+        return($x)
+    endif()
+    return(call(mul,$x,$y - 1) + $x)
+)","mul",{9,8}},
+};
+
+struct Outcome {
+    std::string output;
+    std::string value;
+    std::string error;
+    size_t native_labels = 0;
+};
+
+Outcome run(const Example& example, const std::string& extension) {
+    using namespace carescript;
+    Interpreter interp;
+    auto output = interp.capture_output();
+    Outcome ret;
+    interp.pre_process(example.source);
+    if(interp && extension != "") {
+        interp.bake(extension);
+        ret.native_labels = interp.native_labels.size();
+    }
+    if(interp) ret.value = interp.run(example.label,example.args).get_value().printable();
+    ret.output = output->string();
+    ret.error = interp.error();
+    return ret;
+}
+
+int main(int argc, char** argv) {
+    using namespace carescript;
+    const std::string compiler = argc > 1 ? argv[1] : "g++ -std=c++20 -shared -fPIC";
+    const auto directory = std::filesystem::temp_directory_path() / "carescript-aot-check";
+    std::filesystem::create_directories(directory);
+
+    ScriptAotOptions options;
+    options.include = std::filesystem::absolute(std::filesystem::path(__FILE__).parent_path() / ".." / "carescript-api.hpp").string();
+
+    int failed = 0;
+    for(auto& example : examples) {
+        Interpreter interp;
+        interp.pre_process(example.source);
+        if(!interp) {
+            std::cout << example.name << ": " << interp.error() << "\n";
+            ++failed;
+            continue;
+        }
+        options.id = "aot_check_" + example.name;
+        const auto source = directory / (options.id + ".cpp");
+        const auto library = directory / (options.id + ".so");
+        std::ofstream(source) << transpile(interp.settings,options);
+        if(std::system((compiler + " " + source.string() + " -o " + library.string()).c_str()) != 0) {
+            std::cout << example.name << ": compiling " << source.string() << " failed\n";
+            ++failed;
+            continue;
+        }
+
+        const Outcome interpreted = run(example,"");
+        const Outcome compiled = run(example,library.string());
+        std::vector<std::string> differences;
+        if(compiled.native_labels == 0) differences.push_back("no label was compiled");
+        if(interpreted.output != compiled.output) differences.push_back("output:\n" + interpreted.output + "---\n" + compiled.output);
+        if(interpreted.value != compiled.value) differences.push_back("value: " + interpreted.value + " vs " + compiled.value);
+        if(interpreted.error != compiled.error) differences.push_back("error: " + interpreted.error + "\n---\n" + compiled.error);
+
+        if(differences.empty()) {
+            std::cout << example.name << ": same\n";
+            continue;
+        }
+        ++failed;
+        std::cout << example.name << ": differs\n";
+        for(auto& i : differences) std::cout << i << "\n";
+    }
+    return failed == 0 ? 0 : 1;
+}
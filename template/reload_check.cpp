@@ -0,0 +1,76 @@
+#include "../carescript-api.hpp"
+
+#include <random>
+
+/*
+    This is a template for checking that `reload` gives
+    the same labels, constants and errors as pre processing
+    the new source from scratch. Random pairs of sources
+    are made from the pieces below:
+
+    ./reload_check [pairs] [seed]
+*/
+
+const std::vector<std::string> pieces = {
+    "    echoln(\"stray\")\n",
+    "\n",
+    "# a comment\n",
+    "@foo[a]\n    return($a)\n",
+    "@foo[a]\n    return($a + 1)\n",
+    "@bar[]\n    echoln(\"bar\")\n    return(2)\n",
+    "@bar[]\n\n    return(3)\n",
+    "@main[]\n    echoln(call(foo,1))\n",
+    "@main[]\n    echoln(\"main\")\n",
+    "@const[\n    answer = 42\n]\n",
+    "@const[\n    answer = 7\n    other = $answer + 1\n]\n",
+    "@pragma memoize foo\n",
+    "@baz[x,y]\n    set(z,$x * $y)\n    return($z)\n",
+};
+
+std::string make_source(std::mt19937& random) {
+    std::string ret;
+    const size_t count = random() % 7;
+    for(size_t i = 0; i < count; ++i) ret += pieces[random() % pieces.size()];
+    return ret;
+}
+
+// everything pre processing leaves behind
+std::string describe(carescript::Interpreter& interp) {
+    std::string ret = "error: " + interp.error() + "\n";
+    if(interp.error() != "") return ret;
+    for(auto& [name,label] : interp.settings.labels) {
+        ret += "@" + name + "[";
+        for(auto& i : label.arglist) ret += i + ",";
+        ret += "] at " + std::to_string(label.line) + "\n";
+        for(auto& i : label.lines) ret += "  " + std::to_string(i.line) + (i.str ? " \"" : " ") + i.src + "\n";
+    }
+    for(auto& [name,value] : interp.settings.constants) ret += name + " = " + value.printable() + "\n";
+    return ret;
+}
+
+int main(int argc, char** argv) {
+    using namespace carescript;
+    const size_t pairs = argc > 1 ? std::stoul(argv[1]) : 2000;
+    std::mt19937 random(argc > 2 ? std::stoul(argv[2]) : 1);
+
+    size_t failed = 0;
+    for(size_t i = 0; i < pairs; ++i) {
+        const std::string before = make_source(random);
+        const std::string after = make_source(random);
+
+        Interpreter reloaded;
+        reloaded.pre_process(before);
+        reloaded.reload(after);
+        Interpreter fresh;
+        fresh.pre_process(after);
+
+        const std::string got = describe(reloaded);
+        const std::string expected = describe(fresh);
+        if(got == expected) continue;
+        if(++failed > 3) continue;
+        std::cout << "---- before:\n" << before << "---- after:\n" << after;
+        std::cout << "---- reload gave:\n" << got << "---- pre_process gave:\n" << expected << "\n";
+    }
+    std::cout << failed << " of " << pairs << " differ\n";
+    return failed == 0 ? 0 : 1;
+}